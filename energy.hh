@@ -0,0 +1,89 @@
+/**
+ * energy.hh
+ *
+ * Modelo da energia gasta pelo radiotransmissor em cada operação LoRa,
+ * usado para comparar as combinações de parâmetros pela energia por bit
+ * recebido, além do PER.
+ *
+ * Por padrão, a energia é a corrente típica do SX1262 no modo da operação,
+ * multiplicada pela tensão de alimentação e pela duração da operação. Caso um
+ * sensor de corrente externo (ex. INA219 ou um shunt lido pelo ADC) seja
+ * registrado com `energySetSensor`, a corrente medida substitui o modelo.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+/// Tensão de alimentação do radiotransmissor, em volts.
+#define ENERGY_VOLTAGE 3.3f
+
+/// Corrente típica da recepção, em mA, com e sem o ganho aumentado.
+#define ENERGY_RX_CURRENT 4.6f
+#define ENERGY_RX_BOOSTED_CURRENT 5.3f
+
+/// Quantidade de pontos da tabela de corrente da transmissão.
+#define ENERGY_TX_POINTS 6
+
+/// Corrente típica da transmissão, em mA, para cada potência, em dBm, com a
+/// configuração do PA de +22 dBm usada pelo RadioLib (datasheet do SX1262,
+/// valores aproximados). Potências intermediárias são interpoladas.
+const int8_t _energyTxPower[ENERGY_TX_POINTS] = { -9, 0, 10, 14, 17, 22 };
+const float _energyTxCurrent[ENERGY_TX_POINTS] = { 26, 35, 55, 70, 85, 118 };
+
+/// Retorna a corrente média, em mA, do radiotransmissor desde a última
+/// chamada.
+using energy_sensor_fn = float (*)(void);
+
+/// O sensor de corrente registrado, ou `NULL` para usar o modelo.
+energy_sensor_fn _energySensor = NULL;
+
+/// Registra um sensor de corrente, executado ao fim de cada operação LoRa.
+/// Como ele executa dentro do slot, sua leitura deve ser rápida.
+void energySetSensor(energy_sensor_fn fn) {
+    _energySensor = fn;
+}
+
+/// Retorna a corrente típica, em mA, da transmissão com a potência dada.
+float energyTxCurrent(int8_t power) {
+    if (power <= _energyTxPower[0])
+        return _energyTxCurrent[0];
+
+    for (uint8_t i = 1; i < ENERGY_TX_POINTS; i++) {
+        if (power > _energyTxPower[i])
+            continue;
+
+        const float t = (float)(power - _energyTxPower[i - 1]) /
+                        (_energyTxPower[i] - _energyTxPower[i - 1]);
+        return _energyTxCurrent[i - 1] +
+               t * (_energyTxCurrent[i] - _energyTxCurrent[i - 1]);
+    }
+
+    return _energyTxCurrent[ENERGY_TX_POINTS - 1];
+}
+
+/// Retorna a energia, em joules, de uma operação LoRa com a duração dada em
+/// microsegundos: uma transmissão com a potência `power`, ou uma recepção
+/// com ou sem o ganho aumentado.
+float energyOperation(bool transmit, int8_t power, bool boosted,
+                      int64_t micro) {
+    float current;
+
+    if (_energySensor)
+        current = _energySensor();
+    else if (transmit)
+        current = energyTxCurrent(power);
+    else
+        current = boosted ? ENERGY_RX_BOOSTED_CURRENT : ENERGY_RX_CURRENT;
+
+    return ENERGY_VOLTAGE * (current / 1000) * (micro / 1e6f);
+}
+
+/// Retorna a energia, em joules, por bit de payload recebido com sucesso, ou
+/// infinito caso nenhuma mensagem tenha sido recebida, para que uma
+/// combinação que não entregou nada nunca pareça a mais eficiente.
+float energyPerBit(float energy, uint32_t ok, uint8_t payloadLength) {
+    const uint32_t bits = ok * payloadLength * 8;
+    return bits > 0 ? energy / bits : INFINITY;
+}
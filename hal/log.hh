@@ -4,41 +4,409 @@
  * Abstração para o datalogger utilizado no experimento.
  */
 
+#pragma once
+
 #include <SD.h>
 #include <SPI.h>
 #include <stdarg.h>
 #include <stdio.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "log_format.hh"
+#include "probe.hh"
+
 #define LOG_DEBUG
 
+/// Grava os resultados como registros binários (ver `hal/log_format.hh`) em
+/// vez de texto CSV. Use `tools/log2csv.cpp` para converter o arquivo.
+#define LOG_BINARY
+
+/// Definido na compilação para aparelhos sem o cartão SD: o cartão não é
+/// inicializado, e o log binário é enviado apenas pela telemetria do Serial.
+// #define LOG_NO_SD
+
+#ifdef LOG_BINARY
+#define LOG_FILENAME "/log.bin"
+#else
+#define LOG_FILENAME "/log.txt"
+#endif
+
+/// Grava cada execução do experimento em um arquivo novo, com um índice
+/// antes da extensão (ex. `/log_003.bin`), em vez de continuar o último log.
+#define LOG_ROTATE
+
+/// Quantidade máxima de arquivos criados por `LOG_ROTATE`.
+#define LOG_ROTATE_MAX 1000
+
+/// Tamanho do buffer do datalogger. As escritas são acumuladas no buffer e
+/// gravadas no cartão SD em blocos inteiros, múltiplos do setor de 512
+/// bytes, evitando a leitura e regravação de setores parcialmente escritos.
+#define LOG_BUFFER_SIZE 8192
+#define LOG_SECTOR_SIZE 512
+
+static_assert(LOG_BUFFER_SIZE % LOG_SECTOR_SIZE == 0,
+              "O buffer deve conter setores inteiros");
+
 #define SD_MISO 1
 #define SD_SCK 2
 #define SD_MOSI 3
 #define SD_CS 4
 
+/// Quantidade máxima de trabalhos pendentes na fila do datalogger.
+#define LOG_QUEUE_LENGTH 8
+
+/// Intervalo máximo, em millisegundos, entre as execuções do consumidor
+/// registrado em `logSetConsumer`, caso a task não seja acordada antes.
+#define LOG_POLL_MS 50
+
+/// Baud rate e tamanho do buffer de envio do Serial na telemetria, usada
+/// sem o cartão SD no log binário. O buffer comporta os resultados de vários
+/// testes, para que as escritas da task do datalogger não bloqueiem.
+#define LOG_SERIAL_BAUD 921600
+#define LOG_SERIAL_BUFFER 16384
+
 SPIClass _spiSd = SPIClass(FSPI);
 File _file;
 
+/// O buffer das escritas no cartão SD e a quantidade de bytes pendentes.
+/// Os blocos gravados terminam no fim de um setor do arquivo, mesmo após
+/// `logSync` gravar um setor incompleto.
+static struct {
+    alignas(4) uint8_t data[LOG_BUFFER_SIZE];
+    size_t length;
+
+    /// A posição do fim do arquivo dentro do seu último setor.
+    size_t offset;
+
+    /// `true` caso algum bloco tenha sido gravado desde o último
+    /// `_file.flush()`, que atualiza o tamanho do arquivo no FAT.
+    bool dirty;
+} _logBuffer;
+
+/// Setada com "true" quando o log binário é enviado pelo Serial, em quadros
+/// de `hal/log_format.hh`, por falta do cartão SD.
+bool _logSerial = false;
+
+/// Função executada pela task do datalogger, recebendo os dados e o
+/// argumento passados em `logSubmit`.
+using log_job_fn = void (*)(const void* data, uint32_t arg);
+
+/// Função executada pela task do datalogger sempre que ela acordar, usada
+/// para consumir dados produzidos por outras tasks (ex. `hal/spsc.hh`).
+using log_consumer_fn = void (*)(void);
+
+/// Um trabalho de escrita enviado para a task do datalogger.
+struct log_job_t {
+    log_job_fn fn;
+    const void* data;
+    uint32_t arg;
+};
+
+/// A task do FreeRTOS que executa as escritas no cartão SD.
+TaskHandle_t _logTask = NULL;
+QueueHandle_t _logQueue = NULL;
+log_consumer_fn _logConsumer = NULL;
+
+/// Mantido pela task do datalogger enquanto ela acessa o cartão SD, e por
+/// `logTryLock` antes do light sleep, para que o sleep nunca comece durante
+/// uma escrita nem uma escrita comece antes do sleep.
+SemaphoreHandle_t _logCardMutex = NULL;
+
+/// Liberado pela task do datalogger quando a fila for esvaziada por
+/// `logDrain`.
+SemaphoreHandle_t _logDrained = NULL;
+
+// Executa o consumidor do usuário, caso definido.
+void _logConsume() {
+    if (_logConsumer)
+        (_logConsumer)();
+}
+
+// Executa os trabalhos enviados para a fila, em ordem. O consumidor é
+// executado antes de cada trabalho, para que os dados produzidos antes de um
+// trabalho sejam escritos antes dele.
+void _logTaskLoop(void* _) {
+    log_job_t job;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_POLL_MS));
+        xSemaphoreTake(_logCardMutex, portMAX_DELAY);
+
+        _logConsume();
+
+        while (xQueueReceive(_logQueue, &job, 0) == pdTRUE) {
+            _logConsume();
+            (job.fn)(job.data, job.arg);
+        }
+
+        xSemaphoreGive(_logCardMutex);
+    }
+}
+
+// Sinaliza que todos os trabalhos anteriores foram executados.
+void _logDrainJob(const void* _, uint32_t __) {
+    xSemaphoreGive(_logDrained);
+}
+
+/// Inicia a task do datalogger no núcleo oposto ao núcleo atual, caso ainda
+/// não tenha sido iniciada, de forma que as escritas no cartão SD não
+/// interfiram com o timer e o radiotransmissor.
+void logTaskStart() {
+    if (_logTask != NULL)
+        return;
+
+    _logQueue = xQueueCreate(LOG_QUEUE_LENGTH, sizeof(log_job_t));
+    _logDrained = xSemaphoreCreateBinary();
+    _logCardMutex = xSemaphoreCreateMutex();
+
+    xTaskCreatePinnedToCore(_logTaskLoop, "log", 8192, NULL,
+                            tskIDLE_PRIORITY + 5, &_logTask,
+                            xPortGetCoreID() == 0 ? 1 : 0);
+}
+
+/// Envia um trabalho para ser executado na task do datalogger, sem bloquear.
+/// Os dados apontados por `data` devem permanecer válidos até o trabalho
+/// ser executado. Retorna `false` caso a fila esteja cheia.
+bool logSubmit(log_job_fn fn, const void* data, uint32_t arg = 0) {
+    // Executa imediatamente caso a task não tenha sido iniciada
+    if (_logTask == NULL) {
+        fn(data, arg);
+        return true;
+    }
+
+    const log_job_t job = { .fn = fn, .data = data, .arg = arg };
+    if (xQueueSend(_logQueue, &job, 0) != pdTRUE)
+        return false;
+
+    xTaskNotifyGive(_logTask);
+    return true;
+}
+
+/// Tenta impedir, sem bloquear, que a task do datalogger acesse o cartão SD.
+/// Retorna `true` caso ela esteja aguardando trabalhos, ou não tenha sido
+/// iniciada; neste caso o ESP32 pode entrar em light sleep sem interromper
+/// uma escrita, e a task só volta ao cartão após `logUnlock`.
+bool logTryLock() {
+    return _logTask == NULL || xSemaphoreTake(_logCardMutex, 0) == pdTRUE;
+}
+
+/// Libera o cartão SD para a task do datalogger após `logTryLock`.
+void logUnlock() {
+    if (_logTask != NULL)
+        xSemaphoreGive(_logCardMutex);
+}
+
+/// Define a função executada pela task do datalogger sempre que ela acordar.
+void logSetConsumer(log_consumer_fn fn) {
+    _logConsumer = fn;
+}
+
+/// Acorda a task do datalogger para que o consumidor seja executado, sem
+/// bloquear.
+void logWake() {
+    if (_logTask == NULL) {
+        _logConsume();
+        return;
+    }
+
+    xTaskNotifyGive(_logTask);
+}
+
+/// Aguarda até que todos os trabalhos enviados à task do datalogger tenham
+/// sido executados.
+void logDrain() {
+    if (_logTask == NULL || xTaskGetCurrentTaskHandle() == _logTask) {
+        _logConsume();
+        return;
+    }
+
+    const log_job_t job = { .fn = _logDrainJob, .data = NULL, .arg = 0 };
+    xQueueSend(_logQueue, &job, portMAX_DELAY);
+    xTaskNotifyGive(_logTask);
+    xSemaphoreTake(_logDrained, portMAX_DELAY);
+}
+
+// Envia um registro pelo Serial em um único quadro. O Serial copia o
+// quadro para o seu buffer de envio, transmitido pelo interrupt da UART.
+size_t _logSerialWrite(const void* data, size_t size) {
+    static uint8_t frame[LOG_FRAME_MAX_SIZE];
+
+    if (size > LOG_FRAME_MAX_PAYLOAD)
+        return 0;
+
+    const int64_t start = probeNow();
+    const size_t length = logFrameEncode(data, size, frame);
+    const size_t written = Serial.write(frame, length);
+    probeSince(kProbeLogAppend, start);
+    return written == length ? size : 0;
+}
+
+// Passa a enviar o log binário pelo Serial, com a baud rate e o buffer da
+// telemetria. O buffer só pode ser alterado com o Serial parado.
+void _logSerialBegin() {
+#ifdef LOG_BINARY
+    if (_logSerial)
+        return;
+
+    Serial.println("[hal/log.hh] Enviando o log pelo Serial.");
+    Serial.flush();
+    Serial.end();
+    Serial.setTxBufferSize(LOG_SERIAL_BUFFER);
+    Serial.begin(LOG_SERIAL_BAUD);
+
+    const log_file_header_t header = {
+        .magic = LOG_FORMAT_MAGIC,
+        .version = LOG_FORMAT_VERSION,
+    };
+
+    _logSerial = true;
+    _logSerialWrite(&header, sizeof(header));
+#endif
+}
+
+// Grava os primeiros `size` bytes pendentes do buffer no arquivo, mantendo
+// os bytes restantes no início do buffer.
+void _logWriteBlock(size_t size) {
+    const int64_t start = probeNow();
+    _file.write(_logBuffer.data, size);
+    probeSince(kProbeLogBlock, start);
+    _logBuffer.dirty = true;
+    _logBuffer.offset = (_logBuffer.offset + size) % LOG_SECTOR_SIZE;
+
+    _logBuffer.length -= size;
+    memmove(_logBuffer.data, _logBuffer.data + size, _logBuffer.length);
+}
+
+// Acumula os bytes dados no buffer, gravando cada bloco completo. Caso o
+// arquivo termine no meio de um setor, o bloco é encurtado para terminar no
+// fim do setor.
+size_t _logAppend(const void* data, size_t size) {
+    const uint8_t* src = (const uint8_t*)data;
+    size_t remaining = size;
+
+    while (remaining > 0) {
+        size_t room = LOG_BUFFER_SIZE - _logBuffer.length;
+        size_t copied = remaining < room ? remaining : room;
+
+        memcpy(_logBuffer.data + _logBuffer.length, src, copied);
+        _logBuffer.length += copied;
+        src += copied;
+        remaining -= copied;
+
+        if (_logBuffer.length == LOG_BUFFER_SIZE)
+            _logWriteBlock(LOG_BUFFER_SIZE - _logBuffer.offset);
+    }
+
+    return size;
+}
+
+// Escreve em `dest` o nome do primeiro arquivo de `LOG_ROTATE` que ainda não
+// existe, a partir do nome base. Retorna `false` caso todos existam.
+bool _logRotatedName(const char* filename, char* dest, size_t size) {
+    const char* extension = strrchr(filename, '.');
+    const int stem = extension ? extension - filename : strlen(filename);
+
+    for (uint16_t i = 0; i < LOG_ROTATE_MAX; i++) {
+        snprintf(dest, size, "%.*s_%03u%s", stem, filename, i,
+                 extension ? extension : "");
+
+        if (!SD.exists(dest))
+            return true;
+    }
+
+    return false;
+}
+
 /// Inicializa o datalogger, preparando-o para gravar dados
-/// em um arquivo, dado o nome.
+/// em um arquivo, dado o nome. Sem o cartão SD, o log binário é enviado
+/// pelo Serial, e a função retorna `false`.
 bool logInit(const char* filename) {
+    logTaskStart();
+
+    // Manter o arquivo aberto por uma tentativa anterior de sincronização
+    if (_file)
+        return true;
+
+#ifdef LOG_NO_SD
+    _logSerialBegin();
+    return false;
+#else
     _spiSd.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS);
 
     // Inicializar biblioteca do SD
     if (!SD.begin(SD_CS, _spiSd, 40000000)) {
         Serial.println(
             "[hal/log.hh] Não foi possível inicializar o datalogger.");
+        _logSerialBegin();
         return false;
     }
 
+#ifdef LOG_ROTATE
+    // Usar um arquivo novo para cada execução
+    char rotated[64];
+    if (!_logRotatedName(filename, rotated, sizeof(rotated))) {
+        Serial.println("[hal/log.hh] Arquivos de log esgotados.");
+        _logSerialBegin();
+        return false;
+    }
+
+    filename = rotated;
+#endif
+
     // Abrir arquivo especificado
     _file = SD.open(filename, FILE_APPEND);
+    _logBuffer.length = 0;
+    _logBuffer.dirty = false;
+    _logBuffer.offset = _file ? _file.size() % LOG_SECTOR_SIZE : 0;
     if (!_file) {
         Serial.println("[hal/log.hh] Não foi possível abrir o arquivo.");
+        _logSerialBegin();
         return false;
     }
 
+#ifdef LOG_BINARY
+    // Identificar o formato no início de arquivos novos
+    if (_file.size() == 0) {
+        const log_file_header_t header = {
+            .magic = LOG_FORMAT_MAGIC,
+            .version = LOG_FORMAT_VERSION,
+        };
+
+        _logAppend(&header, sizeof(header));
+    }
+#endif
+
     return true;
+#endif
+}
+
+/// Retorna `true` caso os resultados devam ser gravados como registros
+/// binários, no cartão SD ou na telemetria do Serial. O fallback para o
+/// Serial do modo texto sempre utiliza texto.
+bool logBinary() {
+#ifdef LOG_BINARY
+    return _file || _logSerial;
+#else
+    return false;
+#endif
+}
+
+/// Escreve `size` bytes, sem formatação, no datalogger. Na telemetria do
+/// Serial, cada escrita deve conter um único registro.
+size_t logWrite(const void* data, size_t size) {
+    if (_logSerial)
+        return _logSerialWrite(data, size);
+
+    if (!_file)
+        return 0;
+
+    const int64_t start = probeNow();
+    size_t written = _logAppend(data, size);
+    probeSince(kProbeLogAppend, start);
+    return written;
 }
 
 /// Imprime dados no datalogger, devendo ser executado
@@ -52,7 +420,17 @@ int logPrintf(const char* format, ...) {
 
     // Imprime no Serial como fallback, caso a inicialização tenha falhado
     if (_file) {
-        res = _file.vprintf(format, list);
+        static char line[512];
+
+        const int64_t start = probeNow();
+        res = vsnprintf(line, sizeof(line), format, list);
+        if (res > 0) {
+            const size_t length =
+                (size_t)res < sizeof(line) ? res : sizeof(line) - 1;
+            _logAppend(line, length);
+        }
+
+        probeSince(kProbeLogAppend, start);
     } else if (Serial) {
         res = Serial.vprintf(format, list);
     }
@@ -62,12 +440,60 @@ int logPrintf(const char* format, ...) {
     return res;
 }
 
-/// Escreve os dados do buffer escritos usando `logPrintf` no arquivo.
+/// Lê um arquivo pequeno do cartão SD, como um arquivo de configuração, para
+/// `dest` como uma string terminada em '\0'. Deve ser executado após
+/// `logInit`. Retorna `false` caso o arquivo não exista.
+bool logReadFile(const char* filename, char* dest, size_t size) {
+#ifdef LOG_NO_SD
+    return false;
+#else
+    if (!SD.exists(filename))
+        return false;
+
+    File file = SD.open(filename, FILE_READ);
+    if (!file)
+        return false;
+
+    int length = file.read((uint8_t*)dest, size - 1);
+    file.close();
+
+    dest[length > 0 ? length : 0] = '\0';
+    return true;
+#endif
+}
+
+/// Grava os setores completos do buffer no arquivo, atualizando o tamanho do
+/// arquivo no FAT caso algum bloco tenha sido gravado, inclusive pelas
+/// escritas anteriores. O restante do último setor permanece no buffer, para
+/// que os próximos blocos continuem alinhados.
 bool logFlush() {
-    if (_file)
-        _file.flush();
+    if (!_file)
+        return false;
 
-    return false;
+    const size_t end = _logBuffer.offset + _logBuffer.length;
+    const size_t aligned = (end / LOG_SECTOR_SIZE) * LOG_SECTOR_SIZE;
+    if (aligned > _logBuffer.offset)
+        _logWriteBlock(aligned - _logBuffer.offset);
+
+    if (!_logBuffer.dirty)
+        return false;
+
+    _file.flush();
+    _logBuffer.dirty = false;
+    return true;
+}
+
+/// Grava todos os bytes pendentes, inclusive o último setor incompleto, e
+/// atualiza o FAT, de forma que tudo escrito até aqui sobreviva a uma queda
+/// de energia. Os blocos seguintes voltam a terminar no fim de um setor.
+bool logSync() {
+    if (!_file)
+        return false;
+
+    if (_logBuffer.length > 0)
+        _logWriteBlock(_logBuffer.length);
+
+    return logFlush();
 }
 
 #ifdef LOG_DEBUG
@@ -76,9 +502,28 @@ bool logFlush() {
 #define logDebugPrintf(format, ...) 0
 #endif
 
-/// Finaliza o datalogger, salvando os dados do arquivo.
+/// Finaliza o datalogger, salvando os dados do arquivo. Aguarda todos os
+/// trabalhos pendentes da task do datalogger antes de fechar o arquivo, que
+/// é fechado com o cartão SD travado, já que a task continua executando o
+/// consumidor. Os produtores, como a task do timer, devem ser parados antes.
 void logClose() {
+    logDrain();
+
+    if (_logTask != NULL)
+        xSemaphoreTake(_logCardMutex, portMAX_DELAY);
+
+    if (_logSerial)
+        Serial.flush();
+
+    // Gravar o último setor, mesmo que incompleto
+    if (_file && _logBuffer.length > 0)
+        _logWriteBlock(_logBuffer.length);
+
+#ifndef LOG_NO_SD
     _file.close();
     SD.end();
     _spiSd.end();
+#endif
+
+    logUnlock();
 }
\ No newline at end of file
@@ -0,0 +1,245 @@
+/**
+ * hal/log_format.hh
+ *
+ * Define o formato binário dos registros gravados pelo datalogger. Este
+ * arquivo não depende do Arduino, podendo ser incluído pelas ferramentas
+ * executadas no computador (ver `tools/log2csv.cpp`).
+ *
+ * Um arquivo binário começa com um `log_file_header_t`, seguido de um
+ * `log_test_record_t` para cada combinação de parâmetros, que por sua vez é
+ * seguido pelos `log_message_record_t` de cada mensagem do teste. No log do
+ * transmissor, cada teste pode terminar com os `log_summary_record_t`
+ * enviados pelos receptores.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identifica um arquivo de log binário ("LRLG").
+#define LOG_FORMAT_MAGIC 0x474C524C
+
+/// Versão do formato, incrementada a cada mudança nos registros.
+#define LOG_FORMAT_VERSION 9
+
+/// Quantidade de buckets dos histogramas de RSSI e SNR dos resumos.
+#define LOG_HISTOGRAM_BUCKETS 8
+
+/// Identifica o tipo de cada registro, no primeiro byte.
+enum log_record_type_t : uint8_t {
+    kLogRecordTest = 1,
+    kLogRecordMessage = 2,
+    kLogRecordSummary = 3,
+};
+
+/// Cabeçalho gravado no início de cada arquivo.
+struct __attribute__((packed)) log_file_header_t {
+    uint32_t magic;
+    uint16_t version;
+};
+
+/// Descreve os parâmetros de uma combinação, gravado uma vez por teste.
+struct __attribute__((packed)) log_test_record_t {
+    uint8_t type;
+
+    /// O cargo do aparelho que gravou o log (1 = Tx, 2 = Rx).
+    uint8_t role;
+
+    /// O identificador do aparelho que gravou o log.
+    uint8_t node;
+
+    /// O índice do teste e a quantidade de mensagens planejadas para ele.
+    uint32_t test;
+    uint32_t messages;
+
+    int8_t power;
+    float frequency;
+    uint16_t preambleLength;
+    float bandwidth;
+    uint8_t sf;
+    uint8_t cr;
+    uint8_t crc;
+    uint8_t invertIq;
+    uint8_t boostedRxGain;
+    uint32_t packetLength;
+    uint8_t syncWord;
+
+    /// O comprimento da mensagem enviada no teste, em bytes.
+    uint8_t payloadLength;
+};
+
+/// Resultado de uma única mensagem. Os resultados são armazenados durante o
+/// experimento diretamente neste formato, para que a escrita de cada
+/// resultado seja uma única cópia da memória para o arquivo.
+struct __attribute__((packed)) log_message_record_t {
+    uint8_t type;
+    uint32_t index;
+    int64_t startTime;
+    int64_t loraEndTime;
+    int64_t endTime;
+    int64_t period;
+    int64_t nextAlarm;
+
+    /// Atrasos, em microsegundos, entre o timeout do timer e o início do
+    /// slot, e entre o interrupt do radiotransmissor e o fim da operação
+    /// LoRa. Correspondem à parte do erro de sincronização causada pelo
+    /// software.
+    uint32_t timerLatency;
+    uint32_t irqLatency;
+
+    /// A frequência, em MHz, da mensagem, que varia com os saltos de
+    /// frequência do cronograma.
+    float frequency;
+
+    /// O comprimento da mensagem recebida e a quantidade de bytes do seu
+    /// payload diferentes do pacote esperado.
+    uint8_t length;
+    uint8_t payloadErrors;
+    int16_t rssi;
+    float snr;
+
+    /// Energia, em joules, gasta pelo radiotransmissor na operação LoRa (ver
+    /// `energy.hh`).
+    float energy;
+
+    /// O `radio_error_t` da operação.
+    uint8_t error;
+};
+
+/// Resumo de um teste calculado por um receptor. Gravado no log do próprio
+/// receptor ao fim de cada teste, e no log do transmissor ao receber o resumo
+/// enviado no slot de uplink.
+struct __attribute__((packed)) log_summary_record_t {
+    uint8_t type;
+
+    /// O identificador do receptor que enviou o resumo.
+    uint8_t node;
+    uint32_t test;
+
+    /// Contagem de mensagens recebidas com sucesso, corruptas ou perdidas.
+    uint16_t ok;
+    uint16_t corrupt;
+    uint16_t lost;
+
+    /// Média do RSSI e SNR das mensagens recebidas com sucesso.
+    float rssi;
+    float snr;
+
+    /// Bits de payload recebidos com sucesso por segundo de teste.
+    float goodput;
+
+    /// Energia, em joules, das operações LoRa do teste, e a energia por bit de
+    /// payload recebido com sucesso. No log do transmissor, é a energia gasta
+    /// pelo transmissor para entregar os bits recebidos pelo receptor.
+    float energy;
+    float energyPerBit;
+
+    /// Desvio padrão e extremos do RSSI e SNR das mensagens recebidas com
+    /// sucesso. Os extremos não são enviados no slot de uplink, e são zero
+    /// nos resumos gravados pelo transmissor.
+    float rssiStddev;
+    float snrStddev;
+    float rssiMin;
+    float rssiMax;
+    float snrMin;
+    float snrMax;
+
+    /// Histogramas do RSSI e SNR, com os buckets de `stats.hh`. Também
+    /// zerados nos resumos gravados pelo transmissor.
+    uint16_t rssiHistogram[LOG_HISTOGRAM_BUCKETS];
+    uint16_t snrHistogram[LOG_HISTOGRAM_BUCKETS];
+};
+
+/// Sem o cartão SD, o datalogger envia o mesmo conteúdo do log binário pelo
+/// Serial, com o cabeçalho e cada registro em um quadro separado: os bytes do
+/// registro seguidos do seu CRC-16, codificados com COBS e delimitados por
+/// `LOG_FRAME_DELIMITER` no início e no fim. Como o delimitador nunca aparece
+/// dentro de um quadro, o receptor pode se sincronizar no meio do envio, e
+/// textos impressos no mesmo Serial são descartados pelo CRC.
+#define LOG_FRAME_DELIMITER 0x00
+
+/// Comprimento máximo de um registro em um quadro, mantido abaixo de 254
+/// bytes para que a codificação COBS acrescente um único byte.
+#define LOG_FRAME_MAX_PAYLOAD 250
+
+/// Comprimento máximo de um quadro codificado, com os delimitadores.
+#define LOG_FRAME_MAX_SIZE (LOG_FRAME_MAX_PAYLOAD + 2 + 3)
+
+static_assert(sizeof(log_summary_record_t) <= LOG_FRAME_MAX_PAYLOAD,
+              "Os registros não cabem em um quadro");
+
+/// Calcula o CRC-16/CCITT-FALSE dos bytes dados.
+uint16_t logFrameCrc(const uint8_t* data, size_t size) {
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+/// Codifica `size` bytes, no máximo `LOG_FRAME_MAX_PAYLOAD`, em um quadro em
+/// `dest`, que deve ter `LOG_FRAME_MAX_SIZE` bytes. Retorna o comprimento do
+/// quadro, incluindo os delimitadores.
+size_t logFrameEncode(const void* data, size_t size, uint8_t* dest) {
+    const uint8_t* src = (const uint8_t*)data;
+    const uint16_t crc = logFrameCrc(src, size);
+    const uint8_t trailer[2] = { (uint8_t)(crc >> 8), (uint8_t)crc };
+
+    size_t length = 0;
+    dest[length++] = LOG_FRAME_DELIMITER;
+
+    // Cada byte de código indica a distância até o próximo byte zero
+    size_t code = length++;
+    uint8_t run = 1;
+
+    for (size_t i = 0; i < size + sizeof(trailer); i++) {
+        const uint8_t byte = i < size ? src[i] : trailer[i - size];
+
+        if (byte == 0) {
+            dest[code] = run;
+            code = length++;
+            run = 1;
+        } else {
+            dest[length++] = byte;
+            run++;
+        }
+    }
+
+    dest[code] = run;
+    dest[length++] = LOG_FRAME_DELIMITER;
+    return length;
+}
+
+/// Decodifica os `size` bytes de um quadro, sem os delimitadores, para
+/// `dest`, que deve ter ao menos `size` bytes. Retorna o comprimento do
+/// registro, ou zero caso o quadro seja inválido.
+size_t logFrameDecode(const uint8_t* src, size_t size, uint8_t* dest) {
+    size_t length = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        const uint8_t code = src[i++];
+        if (code == 0 || i + code - 1 > size)
+            return 0;
+
+        for (uint8_t j = 1; j < code; j++)
+            dest[length++] = src[i++];
+
+        // O zero implícito não existe após o último bloco
+        if (i < size)
+            dest[length++] = 0;
+    }
+
+    if (length <= 2)
+        return 0;
+
+    length -= 2;
+    const uint16_t crc = ((uint16_t)dest[length] << 8) | dest[length + 1];
+    return crc == logFrameCrc(dest, length) ? length : 0;
+}
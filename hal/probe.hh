@@ -0,0 +1,189 @@
+/**
+ * hal/probe.hh
+ *
+ * Instrumentação de tempo dos trechos críticos do experimento. Cada probe
+ * acumula as durações medidas em um histograma de buckets fixos, que é
+ * impresso e zerado uma vez por teste, em vez de imprimir cada medida no
+ * Serial durante o slot.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+/// Liga a instrumentação. Caso não definida, as funções de medida não fazem
+/// nada.
+#define PROBE_ENABLED
+
+/// Quantidade de buckets de cada histograma. Os buckets dividem cada
+/// potência de 2 em 4 partes, cobrindo durações de até 2^27us (~134s).
+#define PROBE_BUCKETS 104
+
+/// Identifica os trechos medidos.
+enum probe_id_t {
+    /// Início de uma operação do radiotransmissor (`radioStartSend` e
+    /// `radioStartRecv`).
+    kProbeRadioStart,
+
+    /// Finalização de uma operação, após o interrupt.
+    kProbeRadioFinish,
+
+    /// Atraso entre o interrupt do radiotransmissor e a task que o aguarda
+    /// voltar a executar.
+    kProbeIrqLatency,
+
+    /// Leitura do pacote recebido pelo SPI.
+    kProbeReadData,
+
+    /// Escrita de dados no datalogger.
+    kProbeLogAppend,
+
+    /// Escrita de um bloco do buffer do datalogger no cartão SD.
+    kProbeLogBlock,
+
+    /// Desenho e envio de um frame da interface.
+    kProbeUiFrame,
+
+    /// Saída do radiotransmissor do sleep, e atraso do ESP32 ao acordar do
+    /// light sleep em relação ao instante pedido.
+    kProbeRadioWake,
+    kProbeCpuWake,
+
+    /// Atraso do fim da operação LoRa além do ToA, a partir do início do slot.
+    kProbeLoraExcess,
+
+    /// Processamento após o fim da operação LoRa.
+    kProbeProcessing,
+
+    kProbeCount,
+};
+
+/// Nome impresso para cada probe, na ordem de `probe_id_t`.
+const char* const _probeNames[kProbeCount] = {
+    "radio_start", "radio_finish", "irq_latency", "read_data",
+    "log_append",  "log_block",    "ui_frame",    "radio_wake",
+    "cpu_wake",    "lora_excess",  "processing",
+};
+
+/// As medidas acumuladas de um probe, em microsegundos.
+struct probe_t {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t buckets[PROBE_BUCKETS];
+};
+
+static struct {
+    probe_t probes[kProbeCount];
+} _probeState;
+
+portMUX_TYPE _probeLock = portMUX_INITIALIZER_UNLOCKED;
+
+/// Retorna o tempo atual, em microsegundos, para ser passado a `probeSince`.
+int64_t probeNow() {
+    return esp_timer_get_time();
+}
+
+/// Retorna o bucket de uma duração. Durações menores que 4us possuem buckets
+/// próprios; as demais são divididas em 4 buckets por potência de 2.
+uint8_t _probeBucket(uint32_t value) {
+    if (value < 4)
+        return value;
+
+    const uint8_t msb = 31 - __builtin_clz(value);
+    const uint32_t index = (msb - 1) * 4 + ((value >> (msb - 2)) & 3);
+
+    return index < PROBE_BUCKETS ? index : PROBE_BUCKETS - 1;
+}
+
+/// Retorna a maior duração contida no bucket dado.
+uint32_t _probeBucketMax(uint8_t index) {
+    if (index < 4)
+        return index;
+
+    const uint8_t shift = index / 4 - 1;
+    const uint32_t min = (uint32_t)(4 + index % 4) << shift;
+
+    return min + ((uint32_t)1 << shift) - 1;
+}
+
+/// Registra uma duração, em microsegundos, no probe dado. Durações negativas
+/// são registradas como 0.
+void probeRecord(probe_id_t id, int64_t value) {
+#ifdef PROBE_ENABLED
+    const uint32_t v =
+        value < 0 ? 0 : (value > UINT32_MAX ? UINT32_MAX : value);
+    probe_t& probe = _probeState.probes[id];
+
+    portENTER_CRITICAL(&_probeLock);
+
+    if (probe.count == 0 || v < probe.min)
+        probe.min = v;
+
+    if (probe.count == 0 || v > probe.max)
+        probe.max = v;
+
+    probe.count++;
+    probe.buckets[_probeBucket(v)]++;
+
+    portEXIT_CRITICAL(&_probeLock);
+#endif
+}
+
+/// Registra no probe dado o tempo decorrido desde `start`, obtido com
+/// `probeNow`.
+void probeSince(probe_id_t id, int64_t start) {
+#ifdef PROBE_ENABLED
+    probeRecord(id, probeNow() - start);
+#endif
+}
+
+/// Retorna uma estimativa do percentil dado, de 0 a 100, a partir do maior
+/// valor do bucket que o contém.
+uint32_t probePercentile(const probe_t& probe, uint8_t percentile) {
+    if (probe.count == 0)
+        return 0;
+
+    // A posição do percentil, arredondada para cima
+    const uint64_t rank = ((uint64_t)probe.count * percentile + 99) / 100;
+    uint64_t seen = 0;
+
+    for (uint8_t i = 0; i < PROBE_BUCKETS; i++) {
+        seen += probe.buckets[i];
+
+        if (seen >= rank && seen > 0) {
+            const uint32_t value = _probeBucketMax(i);
+            return constrain(value, probe.min, probe.max);
+        }
+    }
+
+    return probe.max;
+}
+
+/// Imprime no Serial o histograma resumido de todos os probes com medidas,
+/// e os zera. Não deve ser executado nos trechos medidos, pois bloqueia
+/// enquanto imprime.
+void probeDump(uint32_t test) {
+#ifdef PROBE_ENABLED
+    for (uint8_t i = 0; i < kProbeCount; i++) {
+        probe_t probe;
+
+        portENTER_CRITICAL(&_probeLock);
+        probe = _probeState.probes[i];
+        _probeState.probes[i] = {};
+        portEXIT_CRITICAL(&_probeLock);
+
+        if (probe.count == 0)
+            continue;
+
+        Serial.printf(
+            "probe %u %s: n: %u, min: %u, p50: %u, p99: %u, max: %u (us)\n",
+            test, _probeNames[i], probe.count, probe.min,
+            probePercentile(probe, 50), probePercentile(probe, 99),
+            probe.max);
+    }
+#endif
+}
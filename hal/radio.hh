@@ -7,37 +7,159 @@
 
 #pragma once
 
+// `_radio_sx1262_t` usa campos e comandos privados da classe `SX126x`, que
+// só ficam acessíveis com o "god mode" da RadioLib. Deve ser definido antes
+// de qualquer include da biblioteca. Testado com a RadioLib 6.6.0 (ver
+// `sketch.yaml`); outras versões podem ter renomeado esses membros.
+#define RADIOLIB_GODMODE (1)
+
 #include <RadioLib.h>
 #include <stdint.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "probe.hh"
+#include "radio_params.hh"
+
 /// Recebe `true` quando um interrupt for gerado pelo radiotransmissor.
 volatile bool __radioDidIRQ = false;
 
+/// O instante, em microsegundos, do último interrupt do radiotransmissor.
+volatile int64_t __radioIRQTime = 0;
+
+/// Liberado pelo interrupt do radiotransmissor. Permite que a task que
+/// aguarda o fim de uma operação durma em vez de ocupar o núcleo.
+SemaphoreHandle_t __radioIRQSemaphore = NULL;
+
+/// Expõe comandos internos do SX1262 que a RadioLib não disponibiliza
+/// publicamente.
+class _radio_sx1262_t : public SX1262 {
+   public:
+    using SX1262::SX1262;
+
+    /// Atualiza a largura de banda, o SF e o CR com um único comando
+    /// `SetModulationParams`, em vez de um comando para cada parâmetro.
+    /// Realiza as mesmas validações de `setBandwidth`, `setSpreadingFactor`
+    /// e `setCodingRate`.
+    int16_t setModulation(float bw, uint8_t sf, uint8_t cr) {
+        uint8_t bwCode;
+
+        switch ((uint8_t)(bw / 2 + 0.01)) {
+        case 3:
+            bwCode = RADIOLIB_SX126X_LORA_BW_7_8;
+            break;
+        case 5:
+            bwCode = RADIOLIB_SX126X_LORA_BW_10_4;
+            break;
+        case 7:
+            bwCode = RADIOLIB_SX126X_LORA_BW_15_6;
+            break;
+        case 10:
+            bwCode = RADIOLIB_SX126X_LORA_BW_20_8;
+            break;
+        case 15:
+            bwCode = RADIOLIB_SX126X_LORA_BW_31_25;
+            break;
+        case 20:
+            bwCode = RADIOLIB_SX126X_LORA_BW_41_7;
+            break;
+        case 31:
+            bwCode = RADIOLIB_SX126X_LORA_BW_62_5;
+            break;
+        case 62:
+            bwCode = RADIOLIB_SX126X_LORA_BW_125_0;
+            break;
+        case 125:
+            bwCode = RADIOLIB_SX126X_LORA_BW_250_0;
+            break;
+        case 250:
+            bwCode = RADIOLIB_SX126X_LORA_BW_500_0;
+            break;
+        default:
+            return RADIOLIB_ERR_INVALID_BANDWIDTH;
+        }
+
+        if (sf < 5 || sf > 12)
+            return RADIOLIB_ERR_INVALID_SPREADING_FACTOR;
+
+        if (cr < 5 || cr > 8)
+            return RADIOLIB_ERR_INVALID_CODING_RATE;
+
+        // O LDRO é recalculado por `setModulationParams` a partir destes
+        // campos quando `autoLDRO` está ligado
+        this->bandwidth = bwCode;
+        this->bandwidthKhz = bw;
+        this->spreadingFactor = sf;
+        this->codingRate = cr - 4;
+
+        return setModulationParams(this->spreadingFactor, this->bandwidth,
+                                   this->codingRate, this->ldrOptimize);
+    }
+
+    /// Executa todos os passos de `startTransmit`, exceto o comando `SetTx`,
+    /// carregando o pacote no buffer do radiotransmissor.
+    int16_t armTransmit(const uint8_t* data, uint8_t len) {
+        int16_t state =
+            setPacketParams(this->preambleLengthLoRa, this->crcTypeLoRa, len,
+                            this->headerType, this->invertIQEnabled);
+        RADIOLIB_ASSERT(state);
+
+        state = setDioIrqParams(
+            RADIOLIB_SX126X_IRQ_TX_DONE | RADIOLIB_SX126X_IRQ_TIMEOUT,
+            RADIOLIB_SX126X_IRQ_TX_DONE);
+        RADIOLIB_ASSERT(state);
+
+        state = setBufferBaseAddress();
+        RADIOLIB_ASSERT(state);
+
+        state = writeBuffer((uint8_t*)data, len);
+        RADIOLIB_ASSERT(state);
+
+        state = clearIrqStatus();
+        RADIOLIB_ASSERT(state);
+
+        return fixSensitivity();
+    }
+
+    /// Sobrescreve `len` bytes do pacote carregado por `armTransmit`, a
+    /// partir de `offset`.
+    int16_t patchTransmit(uint8_t offset, const uint8_t* data, uint8_t len) {
+        return writeBuffer((uint8_t*)data, len, offset);
+    }
+
+    /// Inicia a transmissão carregada por `armTransmit`.
+    int16_t fireTransmit() {
+        this->mod->setRfSwitchState(this->txMode);
+        return setTx(RADIOLIB_SX126X_TX_TIMEOUT_NONE);
+    }
+
+    /// Executa todos os passos de `startReceive`, exceto o comando `SetRx`.
+    int16_t armReceive(uint32_t timeout) {
+        return startReceiveCommon(timeout);
+    }
+
+    /// Inicia a recepção preparada por `armReceive`.
+    int16_t fireReceive(uint32_t timeout) {
+        this->mod->setRfSwitchState(Module::MODE_RX);
+        return setRx(timeout);
+    }
+};
+
 SPIClass _radioSPI = SPIClass(HSPI);
-SX1262 _radio = new Module(SS, DIO0, RST_LoRa, BUSY_LoRa, _radioSPI);
+_radio_sx1262_t _radio =
+    new Module(SS, DIO0, RST_LoRa, BUSY_LoRa, _radioSPI);
 
 #if defined(ESP8266) || defined(ESP32)
 ICACHE_RAM_ATTR
 #endif
 void __radioIRQ(void) {
+    __radioIRQTime = esp_timer_get_time();
     __radioDidIRQ = true;
-}
-
-enum radio_error_t {
-    kNone,
 
-    /// A mensagem recebida chegou corrompida.
-    kCrc,
-
-    /// A mensagem recebida veio com o header inválido.
-    kHeader,
-
-    /// Houve um timeout na operação desejada.
-    kTimeout,
-
-    /// Houve um erro de tipo inesperado.
-    kUnknown,
-};
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(__radioIRQSemaphore, &woken);
+    portYIELD_FROM_ISR(woken);
+}
 
 /// Converte os erros da RadioLib em `radio_error_t`
 radio_error_t _radioConvertError(int16_t e) {
@@ -61,44 +183,68 @@ radio_error_t _radioConvertError(int16_t e) {
     }
 }
 
-/// Define todos os parâmetros modificáveis do radiotransmissor.
-struct radio_parameters_t {
-    /// A potência de transmissão, de -9 a 22dBm.
-    int8_t power;
+/// Função executada quando uma operação assíncrona do radiotransmissor
+/// terminar, recebendo o resultado da operação.
+using radio_callback_fn = void (*)(radio_error_t);
 
-    /// A frequência da transmissão, em MHz.
-    float frequency;
-    uint16_t preambleLength;
+/// Descreve a operação atualmente em andamento no radiotransmissor.
+enum radio_operation_t {
+    kRadioIdle,
+    kRadioSending,
+    kRadioReceiving,
+};
 
-    /// A largura de banda, em kHz.
-    float bandwidth;
+static struct {
+    /// A operação iniciada por `radioStartSend` ou `radioStartRecv`.
+    radio_operation_t operation;
 
-    /// O fator de espalhamento, ou `spreading factor`, de 7 a 12
-    uint8_t sf;
+    /// Função do usuário executada ao fim da operação atual.
+    radio_callback_fn callback;
 
-    /// O denominador da taxa de codificação, ou `coding rate`, de 4 a 8.
-    uint8_t cr;
+    /// Buffer de destino e tamanho da recepção atual.
+    uint8_t* dest;
+    uint8_t* length;
 
-    /// Liga ou desliga o código de detecção de erro incluido em cada
-    /// mensagem.
-    bool crc;
-    bool invertIq;
+    /// O resultado da última operação finalizada.
+    radio_error_t result;
 
-    /// Determina a sensibilidade extra do receptor, `false` para o modo
-    /// de economia de energia.
-    bool boostedRxGain;
+    /// RSSI e SNR da última mensagem recebida, lidos ao fim da recepção para
+    /// que outras tasks não precisem acessar o barramento SPI do radio.
+    int16_t rssi;
+    float snr;
 
-    /// Comprimento padrão do pacote. Caso maior que 0, o modo de header
-    /// implícito é ligado.
-    uint32_t packetLength;
+    /// Atraso, em microsegundos, entre o interrupt da última operação e o
+    /// início de sua finalização pela task que a aguardava.
+    int64_t irqLatency;
 
-    /// O byte usado como "endereço" de cada pacote.
-    uint8_t syncWord;
-};
+    /// A operação preparada por `radioArmSend` ou `radioArmRecv`, iniciada
+    /// por `radioFire`, e o timeout da recepção preparada.
+    radio_operation_t armed;
+    uint32_t armedTimeout;
+
+    /// `true` caso o radiotransmissor esteja em sleep (ver `radioSleep`).
+    bool asleep;
+} _radioState;
+
+static struct {
+    /// Os últimos parâmetros aplicados por `radioSetParameters`.
+    radio_parameters_t parameters;
+
+    /// `false` caso o estado do radiotransmissor seja desconhecido, forçando
+    /// que todos os parâmetros sejam reprogramados.
+    bool valid;
+} _radioApplied;
 
 /// Inicializa o radio LoRa.
 /// Retorna `true` caso o radio tenha inicializado com sucesso.
 bool radioInit() {
+    if (__radioIRQSemaphore == NULL)
+        __radioIRQSemaphore = xSemaphoreCreateBinary();
+
+    _radioState = {};
+    _radioState.operation = kRadioIdle;
+    _radioState.result = kNone;
+
     _radioSPI.begin(SCK, MISO, MOSI, SS);
 
     if (_radio.begin(915.0, 125.0, 7, 5, 0xAE, 5, 8, 1.8, false) !=
@@ -107,28 +253,264 @@ bool radioInit() {
 
     _radio.setDio1Action(__radioIRQ);
     _radio.setTCXO(1.8, 5000);
+    _radio.autoLDRO();
     _radio.standbyXOSC = true;
     _radio.standby();
+
+    // Os parâmetros de `begin` não correspondem a nenhum `radio_parameters_t`
+    _radioApplied.valid = false;
     return true;
 }
 
+/// Coloca o radiotransmissor em sleep com warm start, desligando o TCXO, até
+/// a próxima operação. A configuração é mantida, mas a operação preparada é
+/// descartada, já que o buffer de dados não é mantido no sleep.
+void radioSleep() {
+    if (_radioState.operation != kRadioIdle || _radioState.asleep)
+        return;
+
+    _radioState.armed = kRadioIdle;
+    _radioState.asleep = _radio.sleep(true) == RADIOLIB_ERR_NONE;
+}
+
+/// Acorda o radiotransmissor do sleep, voltando ao standby com o TCXO ligado.
+/// Executado automaticamente antes de cada operação. Retorna o tempo gasto,
+/// em microsegundos.
+int64_t radioWake() {
+    if (!_radioState.asleep)
+        return 0;
+
+    const int64_t start = probeNow();
+    _radio.standby();
+    _radioState.asleep = false;
+
+    const int64_t elapsed = probeNow() - start;
+    probeRecord(kProbeRadioWake, elapsed);
+    return elapsed;
+}
+
+/// Prepara o estado interno para uma nova operação assíncrona.
+void _radioBeginOperation(radio_operation_t operation, radio_callback_fn fn) {
+    // Descarta interrupts pendentes de operações anteriores
+    __radioDidIRQ = false;
+    xSemaphoreTake(__radioIRQSemaphore, 0);
+
+    _radioState.operation = operation;
+    _radioState.callback = fn;
+}
+
+/// Finaliza a operação atual após o interrupt, lendo o resultado do
+/// radiotransmissor e executando o callback do usuário.
+radio_error_t _radioFinishOperation() {
+    const int64_t start = probeNow();
+    int16_t status = RADIOLIB_ERR_NONE;
+    __radioDidIRQ = false;
+
+    _radioState.irqLatency = start - __radioIRQTime;
+    probeRecord(kProbeIrqLatency, _radioState.irqLatency);
+
+    if (_radioState.operation == kRadioSending) {
+        status = _radio.finishTransmit();
+    } else if (_radioState.operation == kRadioReceiving) {
+        size_t msgLength = _radio.getPacketLength();
+
+        // Evitar buffer overflow
+        if (msgLength < *_radioState.length)
+            *_radioState.length = msgLength;
+
+        const int64_t readStart = probeNow();
+        status = _radio.readData(_radioState.dest, *_radioState.length);
+        probeSince(kProbeReadData, readStart);
+
+        _radioState.rssi = _radio.getRSSI();
+        _radioState.snr = _radio.getSNR();
+    }
+
+    _radio.standby();
+
+    radio_callback_fn fn = _radioState.callback;
+    _radioState.operation = kRadioIdle;
+    _radioState.callback = NULL;
+    _radioState.result = _radioConvertError(status);
+    probeSince(kProbeRadioFinish, start);
+
+    if (fn)
+        fn(_radioState.result);
+
+    return _radioState.result;
+}
+
+/// Inicia o envio de um pacote sem aguardar o fim da transmissão.
+/// O buffer `message` deve permanecer válido até o fim da operação, que pode
+/// ser verificado com `radioPoll` ou aguardado com `radioWait`. Caso
+/// especificado, `fn` será executado ao fim da transmissão.
+radio_error_t radioStartSend(const uint8_t* message, uint8_t size,
+                             radio_callback_fn fn = NULL) {
+    radioWake();
+    const int64_t start = probeNow();
+    _radioState.armed = kRadioIdle;
+    _radioBeginOperation(kRadioSending, fn);
+
+    int16_t status = _radio.startTransmit((uint8_t*)message, size);
+    radio_error_t error = _radioConvertError(status);
+    probeSince(kProbeRadioStart, start);
+
+    if (error != kNone)
+        _radioState.operation = kRadioIdle;
+
+    return error;
+}
+
+/// Inicia a recepção de um pacote sem aguardar sua chegada, com um timeout
+/// opcional em microsegundos. Recebe em `*length` o tamanho do buffer de
+/// destino e, ao fim da operação, armazena o tamanho do pacote lido. Ambos
+/// os ponteiros devem permanecer válidos até o fim da operação.
+radio_error_t radioStartRecv(uint8_t* dest, uint8_t* length,
+                             uint64_t timeout = 0,
+                             radio_callback_fn fn = NULL) {
+    radioWake();
+    const int64_t start = probeNow();
+    _radioState.armed = kRadioIdle;
+    _radioBeginOperation(kRadioReceiving, fn);
+    _radioState.dest = dest;
+    _radioState.length = length;
+
+    auto timeoutReal = _radio.calculateRxTimeout(timeout);
+    int16_t status = _radio.startReceive(timeoutReal);
+    radio_error_t error = _radioConvertError(status);
+    probeSince(kProbeRadioStart, start);
+
+    if (error != kNone)
+        _radioState.operation = kRadioIdle;
+
+    return error;
+}
+
+/// Carrega um pacote no buffer do radiotransmissor, sem iniciar a
+/// transmissão. A transmissão pode então ser iniciada por `radioFire` com um
+/// único comando SPI, por exemplo no início do próximo slot.
+radio_error_t radioArmSend(const uint8_t* message, uint8_t size) {
+    radioWake();
+    _radioState.armed = kRadioIdle;
+
+    radio_error_t error = _radioConvertError(_radio.armTransmit(message, size));
+    if (error == kNone)
+        _radioState.armed = kRadioSending;
+
+    return error;
+}
+
+/// Sobrescreve parte do pacote carregado por `radioArmSend`, como um
+/// timestamp que só é conhecido no início do slot.
+radio_error_t radioPatchArmed(uint8_t offset, const void* data, uint8_t size) {
+    if (_radioState.armed != kRadioSending)
+        return kUnknown;
+
+    return _radioConvertError(
+        _radio.patchTransmit(offset, (const uint8_t*)data, size));
+}
+
+/// Prepara a recepção de um pacote, sem iniciá-la. Os parâmetros são os
+/// mesmos de `radioStartRecv`, e ambos os ponteiros devem permanecer válidos
+/// até o fim da operação iniciada por `radioFire`.
+radio_error_t radioArmRecv(uint8_t* dest, uint8_t* length,
+                           uint64_t timeout = 0) {
+    radioWake();
+    _radioState.armed = kRadioIdle;
+    _radioState.dest = dest;
+    _radioState.length = length;
+    _radioState.armedTimeout = _radio.calculateRxTimeout(timeout);
+
+    radio_error_t error =
+        _radioConvertError(_radio.armReceive(_radioState.armedTimeout));
+    if (error == kNone)
+        _radioState.armed = kRadioReceiving;
+
+    return error;
+}
+
+/// Retorna `true` caso exista uma operação preparada aguardando `radioFire`.
+bool radioArmed() {
+    return _radioState.armed != kRadioIdle;
+}
+
+/// Descarta a operação preparada, caso exista.
+void radioDisarm() {
+    _radioState.armed = kRadioIdle;
+}
+
+/// Inicia a operação preparada por `radioArmSend` ou `radioArmRecv`, sem
+/// aguardar seu fim, da mesma forma que `radioStartSend` e `radioStartRecv`.
+radio_error_t radioFire(radio_callback_fn fn = NULL) {
+    const int64_t start = probeNow();
+    const radio_operation_t operation = _radioState.armed;
+
+    if (operation == kRadioIdle)
+        return kUnknown;
+
+    _radioState.armed = kRadioIdle;
+    _radioBeginOperation(operation, fn);
+
+    int16_t status = operation == kRadioSending
+                         ? _radio.fireTransmit()
+                         : _radio.fireReceive(_radioState.armedTimeout);
+    radio_error_t error = _radioConvertError(status);
+    probeSince(kProbeRadioStart, start);
+
+    if (error != kNone)
+        _radioState.operation = kRadioIdle;
+
+    return error;
+}
+
+/// Retorna `true` caso exista uma operação em andamento.
+bool radioPending() {
+    return _radioState.operation != kRadioIdle;
+}
+
+/// Verifica, sem bloquear, se a operação atual terminou, finalizando-a caso
+/// necessário. Retorna `true` caso não haja mais nenhuma operação em
+/// andamento.
+bool radioPoll() {
+    if (_radioState.operation == kRadioIdle)
+        return true;
+
+    if (!__radioDidIRQ)
+        return false;
+
+    xSemaphoreTake(__radioIRQSemaphore, 0);
+    _radioFinishOperation();
+    return true;
+}
+
+/// Aguarda o fim da operação atual, bloqueando a task até o interrupt do
+/// radiotransmissor, e retorna o resultado da operação.
+radio_error_t radioWait() {
+    if (_radioState.operation == kRadioIdle)
+        return _radioState.result;
+
+    // Dormir até o interrupt, liberando o núcleo para outras tasks.
+    while (!__radioDidIRQ)
+        xSemaphoreTake(__radioIRQSemaphore, portMAX_DELAY);
+
+    return _radioFinishOperation();
+}
+
+/// Retorna o resultado da última operação finalizada.
+radio_error_t radioResult() {
+    return _radioState.result;
+}
+
 /// Envia um pacote e aguarda ele terminar de ser enviado,
 /// retornando o resultado da transmissão.
 radio_error_t radioSend(const uint8_t* message, uint8_t size) {
-    int16_t status = _radio.startTransmit((uint8_t*)message, size);
-    radio_error_t error = _radioConvertError(status);
+    radio_error_t error = radioStartSend(message, size);
 
     // Não aguarda o fim da transmissão caso ocorra um erro.
     if (error != kNone)
         return error;
 
-    // Aguarda o pacote ser enviado completamente.
-    while (!__radioDidIRQ);
-    __radioDidIRQ = false;
-
-    status = _radio.finishTransmit();
-    _radio.standby();
-    return _radioConvertError(status);
+    return radioWait();
 }
 
 /// Aguarda até que um pacote seja recebido, ou ocorra timeout (passado em
@@ -136,67 +518,125 @@ radio_error_t radioSend(const uint8_t* message, uint8_t size) {
 /// tamanho do buffer de destino e, após a operação, armazezna o tamanho do
 /// pacote lido.
 radio_error_t radioRecv(uint8_t* dest, uint8_t* length, uint64_t timeout = 0) {
-    auto timeoutReal = _radio.calculateRxTimeout(timeout);
-    int16_t status = _radio.startReceive(timeoutReal);
-    radio_error_t error = _radioConvertError(status);
+    radio_error_t error = radioStartRecv(dest, length, timeout);
 
     // Não aguarda até o fim da operação caso ocorra um erro.
     if (error != kNone)
         return error;
 
-    // Aguarda o pacote ser recebido, ou o timeout.
-    while (!__radioDidIRQ);
-    __radioDidIRQ = false;
-
-    size_t msgLength = _radio.getPacketLength();
-
-    // Evitar buffer overflow
-    if (*length < msgLength)
-        *length = msgLength;
+    return radioWait();
+}
 
-    status = _radio.readData(dest, *length);
-    _radio.standby();
-    return _radioConvertError(status);
+bool radioBusy() {
+    return digitalRead(BUSY_LoRa) == HIGH;
 }
 
-/// Retorna o tempo esperado de transmissão, em millisegundos, dados
-/// os parâmetros definidos e o comprimento do pacote a ser medido.
-uint64_t radioTransmitTime(radio_parameters_t& _param, uint32_t packetLength) {
-    return _radio.getTimeOnAir(packetLength);
+/// Retorna o atraso, em microsegundos, entre o interrupt da última operação
+/// finalizada e a task que a aguardava voltar a executar.
+int64_t radioIRQLatency() {
+    return _radioState.irqLatency;
 }
 
-bool radioBusy() {
-    return digitalRead(BUSY_LoRa) == HIGH;
+/// Retorna o instante, em microsegundos, do interrupt da última operação.
+int64_t radioIRQTime() {
+    return __radioIRQTime;
 }
 
 /// Retorna o RSSI da última mensagem recebida.
 int16_t radioRSSI() {
-    return _radio.getRSSI();
+    return _radioState.rssi;
 }
 
 /// Retorna o SNR da última mensagem recebida.
 float radioSNR() {
-    return _radio.getSNR();
+    return _radioState.snr;
+}
+
+/// Envia a `radio` os parâmetros de `param` diferentes de `last`, ou todos
+/// caso `all` seja `true`. Retorna `false` caso algum comando tenha falhado.
+bool _radioApplyParameters(_radio_sx1262_t& radio,
+                           const radio_parameters_t& param,
+                           const radio_parameters_t& last, bool all) {
+    bool ok = true;
+
+    // Registra se algum dos comandos enviados falhou
+    auto check = [&ok](int16_t status) { ok &= status == RADIOLIB_ERR_NONE; };
+
+    if (all || param.power != last.power)
+        check(radio.setOutputPower(param.power));
+
+    if (all || param.bandwidth != last.bandwidth || param.sf != last.sf ||
+        param.cr != last.cr)
+        check(radio.setModulation(param.bandwidth, param.sf, param.cr));
+
+    if (all || param.crc != last.crc)
+        check(radio.setCRC(param.crc));
+
+    if (all || param.preambleLength != last.preambleLength)
+        check(radio.setPreambleLength(param.preambleLength));
+
+    if (all || param.boostedRxGain != last.boostedRxGain)
+        check(radio.setRxBoostedGainMode(param.boostedRxGain));
+
+    if (all || param.packetLength != last.packetLength) {
+        if (param.packetLength > 0) {
+            check(radio.implicitHeader(param.packetLength));
+        } else {
+            check(radio.explicitHeader());
+        }
+    }
+
+    if (all || param.invertIq != last.invertIq)
+        check(radio.invertIQ(param.invertIq));
+
+    if (all || param.syncWord != last.syncWord)
+        check(radio.setSyncWord(param.syncWord));
+
+    if (all || param.frequency != last.frequency)
+        check(radio.setFrequency(param.frequency));
+
+    return ok;
 }
 
 /// Atualiza os parâmetros do radiotransmissor.
+///
+/// Apenas os parâmetros diferentes dos aplicados na última chamada são
+/// enviados ao radiotransmissor, evitando os comandos SPI (e a calibração de
+/// imagem da frequência) quando os parâmetros não mudaram.
 void radioSetParameters(const radio_parameters_t& param) {
-    _radio.autoLDRO();
-    _radio.setOutputPower(param.power);
-    _radio.setBandwidth(param.bandwidth);
-    _radio.setSpreadingFactor(param.sf);
-    _radio.setCodingRate(param.cr);
-    _radio.setCRC(param.crc);
-    _radio.setPreambleLength(param.preambleLength);
-    _radio.setRxBoostedGainMode(param.boostedRxGain);
-
-    if (param.packetLength > 0) {
-        _radio.implicitHeader(param.packetLength);
-    } else {
-        _radio.explicitHeader();
+    const radio_parameters_t& last = _radioApplied.parameters;
+    const bool all = !_radioApplied.valid;
+
+    radioWake();
+    const bool ok = _radioApplyParameters(_radio, param, last, all);
+
+    // A operação preparada usa os parâmetros anteriores
+    if (all || !radioParametersEqual(param, last))
+        _radioState.armed = kRadioIdle;
+
+    // Reprogramar tudo na próxima chamada caso algum comando tenha falhado
+    _radioApplied.parameters = param;
+    _radioApplied.valid = ok;
+}
+
+/// Muda apenas a frequência do radiotransmissor, sem refazer a calibração de
+/// imagem. A frequência deve estar na mesma banda de calibração da última
+/// frequência aplicada por `radioSetParameters`. Não altera a operação
+/// preparada.
+radio_error_t radioHop(float frequency) {
+    radio_parameters_t& last = _radioApplied.parameters;
+
+    if (_radioApplied.valid && frequency == last.frequency)
+        return kNone;
+
+    radioWake();
+    if (_radio.setFrequency(frequency, false) != RADIOLIB_ERR_NONE) {
+        _radioApplied.valid = false;
+        return kUnknown;
     }
 
-    _radio.invertIQ(param.invertIq);
-    _radio.setSyncWord(param.syncWord);
-    _radio.setFrequency(param.frequency);
-}
\ No newline at end of file
+    // A próxima chamada de `radioSetParameters` volta à frequência do teste,
+    // com a calibração completa
+    last.frequency = frequency;
+    return kNone;
+}
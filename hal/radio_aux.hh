@@ -0,0 +1,152 @@
+/**
+ * hal/radio_aux.hh
+ *
+ * Segundo radiotransmissor SX1262, externo à placa, usado apenas pelo modo
+ * de loopback para receber as mensagens enviadas pelo radiotransmissor da
+ * placa (`hal/radio.hh`) no mesmo aparelho.
+ *
+ * O ESP32-S3 possui apenas dois barramentos SPI livres: o HSPI é usado pelo
+ * radiotransmissor da placa e o FSPI pelo cartão SD. O módulo externo usa os
+ * pinos do FSPI do cartão, com o seu próprio CS, e portanto o cartão SD não
+ * é usado junto com este módulo. As funções devem ser executadas por uma
+ * única task, podendo ser em um núcleo diferente do radiotransmissor da
+ * placa, já que os dois não compartilham o barramento nem o interrupt.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "log.hh"
+
+// Inclui a RadioLib com o "god mode", usado por `_radio_sx1262_t`
+#include "radio.hh"
+
+/// Pinos do módulo externo, que devem corresponder à ligação feita na placa.
+/// O SCK, MISO e MOSI são os do cartão SD.
+#define RADIO_AUX_CS 5
+#define RADIO_AUX_DIO1 6
+#define RADIO_AUX_RST 7
+#define RADIO_AUX_BUSY 38
+
+/// Tensão do TCXO do módulo externo, ou 0 caso ele use um cristal comum.
+#define RADIO_AUX_TCXO 1.8
+
+SPIClass _radioAuxSPI = SPIClass(FSPI);
+_radio_sx1262_t _radioAux = new Module(RADIO_AUX_CS, RADIO_AUX_DIO1,
+                                       RADIO_AUX_RST, RADIO_AUX_BUSY,
+                                       _radioAuxSPI);
+
+static struct {
+    /// Recebe `true` quando um interrupt for gerado pelo módulo externo, no
+    /// instante `irqTime`, liberando `irqSemaphore`.
+    volatile bool didIRQ;
+    volatile int64_t irqTime;
+    SemaphoreHandle_t irqSemaphore;
+
+    /// Buffer de destino e tamanho da recepção atual.
+    uint8_t* dest;
+    uint8_t* length;
+
+    /// RSSI e SNR da última mensagem recebida.
+    int16_t rssi;
+    float snr;
+} _radioAuxState;
+
+#if defined(ESP8266) || defined(ESP32)
+ICACHE_RAM_ATTR
+#endif
+void __radioAuxIRQ(void) {
+    _radioAuxState.irqTime = esp_timer_get_time();
+    _radioAuxState.didIRQ = true;
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(_radioAuxState.irqSemaphore, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/// Inicializa o módulo externo. Deve ser executado após `radioInit`, e sem
+/// `logInit`, já que o barramento do cartão SD passa a ser deste módulo.
+/// Retorna `true` caso o módulo tenha inicializado com sucesso.
+bool radioAuxInit() {
+    if (_radioAuxState.irqSemaphore == NULL)
+        _radioAuxState.irqSemaphore = xSemaphoreCreateBinary();
+
+    // Manter o cartão SD, caso presente, fora do barramento
+    pinMode(SD_CS, OUTPUT);
+    digitalWrite(SD_CS, HIGH);
+
+    _radioAuxSPI.begin(SD_SCK, SD_MISO, SD_MOSI, RADIO_AUX_CS);
+
+    if (_radioAux.begin(915.0, 125.0, 7, 5, 0xAE, 5, 8, RADIO_AUX_TCXO,
+                        false) != RADIOLIB_ERR_NONE)
+        return false;
+
+    _radioAux.setDio1Action(__radioAuxIRQ);
+    _radioAux.autoLDRO();
+    _radioAux.standby();
+    return true;
+}
+
+/// Aplica todos os parâmetros ao módulo externo. Retorna `false` caso algum
+/// comando tenha falhado.
+bool radioAuxSetParameters(const radio_parameters_t& param) {
+    return _radioApplyParameters(_radioAux, param, param, true);
+}
+
+/// Inicia a recepção de um pacote sem aguardar sua chegada, com um timeout
+/// opcional em microsegundos, da mesma forma que `radioStartRecv`.
+radio_error_t radioAuxStartRecv(uint8_t* dest, uint8_t* length,
+                                uint64_t timeout = 0) {
+    // Descarta interrupts pendentes de operações anteriores
+    _radioAuxState.didIRQ = false;
+    xSemaphoreTake(_radioAuxState.irqSemaphore, 0);
+
+    _radioAuxState.dest = dest;
+    _radioAuxState.length = length;
+
+    const uint32_t timeoutReal = _radioAux.calculateRxTimeout(timeout);
+    return _radioConvertError(_radioAux.startReceive(timeoutReal));
+}
+
+/// Aguarda o fim da recepção iniciada por `radioAuxStartRecv`, bloqueando a
+/// task até o interrupt, e retorna o resultado da recepção. O pacote é lido
+/// para o buffer de destino antes do retorno, de forma que a próxima
+/// recepção pode ser iniciada logo em seguida.
+radio_error_t radioAuxWait() {
+    while (!_radioAuxState.didIRQ)
+        xSemaphoreTake(_radioAuxState.irqSemaphore, portMAX_DELAY);
+
+    _radioAuxState.didIRQ = false;
+
+    // Evitar buffer overflow
+    size_t msgLength = _radioAux.getPacketLength();
+    if (msgLength < *_radioAuxState.length)
+        *_radioAuxState.length = msgLength;
+
+    int16_t status =
+        _radioAux.readData(_radioAuxState.dest, *_radioAuxState.length);
+
+    _radioAuxState.rssi = _radioAux.getRSSI();
+    _radioAuxState.snr = _radioAux.getSNR();
+    _radioAux.standby();
+
+    return _radioConvertError(status);
+}
+
+/// Retorna o instante, em microsegundos, do interrupt da última recepção.
+int64_t radioAuxIRQTime() {
+    return _radioAuxState.irqTime;
+}
+
+/// Retorna o RSSI da última mensagem recebida pelo módulo externo.
+int16_t radioAuxRSSI() {
+    return _radioAuxState.rssi;
+}
+
+/// Retorna o SNR da última mensagem recebida pelo módulo externo.
+float radioAuxSNR() {
+    return _radioAuxState.snr;
+}
@@ -0,0 +1,203 @@
+/**
+ * hal/radio_params.hh
+ *
+ * Os parâmetros e erros do radiotransmissor e o modelo de ToA, sem depender
+ * da RadioLib, para que também sejam usados pelo simulador em `host/`.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+enum radio_error_t {
+    kNone,
+
+    /// A mensagem recebida chegou corrompida.
+    kCrc,
+
+    /// A mensagem recebida veio com o header inválido.
+    kHeader,
+
+    /// Houve um timeout na operação desejada.
+    kTimeout,
+
+    /// Houve um erro de tipo inesperado.
+    kUnknown,
+};
+
+/// Define todos os parâmetros modificáveis do radiotransmissor.
+struct radio_parameters_t {
+    /// A potência de transmissão, de -9 a 22dBm.
+    int8_t power;
+
+    /// A frequência da transmissão, em MHz.
+    float frequency;
+    uint16_t preambleLength;
+
+    /// A largura de banda, em kHz.
+    float bandwidth;
+
+    /// O fator de espalhamento, ou `spreading factor`, de 7 a 12
+    uint8_t sf;
+
+    /// O denominador da taxa de codificação, ou `coding rate`, de 4 a 8.
+    uint8_t cr;
+
+    /// Liga ou desliga o código de detecção de erro incluido em cada
+    /// mensagem.
+    bool crc;
+    bool invertIq;
+
+    /// Determina a sensibilidade extra do receptor, `false` para o modo
+    /// de economia de energia.
+    bool boostedRxGain;
+
+    /// Comprimento padrão do pacote. Caso maior que 0, o modo de header
+    /// implícito é ligado.
+    uint32_t packetLength;
+
+    /// O byte usado como "endereço" de cada pacote.
+    uint8_t syncWord;
+};
+
+/// Retorna `true` caso todos os parâmetros sejam iguais. Os campos são
+/// comparados um a um, já que os bytes de padding da struct são
+/// indeterminados.
+bool radioParametersEqual(const radio_parameters_t& a,
+                          const radio_parameters_t& b) {
+    return a.power == b.power && a.frequency == b.frequency &&
+           a.preambleLength == b.preambleLength &&
+           a.bandwidth == b.bandwidth && a.sf == b.sf && a.cr == b.cr &&
+           a.crc == b.crc && a.invertIq == b.invertIq &&
+           a.boostedRxGain == b.boostedRxGain &&
+           a.packetLength == b.packetLength && a.syncWord == b.syncWord;
+}
+
+/// Retorna a banda de calibração de imagem usada pelo `setFrequency` da
+/// RadioLib para a frequência dada, em MHz: 0 para 430-440 MHz, 1 para
+/// 470-510 MHz, 2 para 779-787 MHz, 3 para 863-870 MHz e 4 para 902-928 MHz.
+/// Frequências da mesma banda podem ser trocadas sem recalibrar.
+uint8_t radioCalibrationBand(float frequency) {
+    const float limits[] = { 460, 770, 850, 900 };
+
+    uint8_t band = 0;
+    for (float limit : limits)
+        band += frequency > limit;
+
+    return band;
+}
+
+/// Quantidade de combinações de parâmetros armazenadas no cache de ToA.
+#define RADIO_TOA_CACHE_SIZE 8
+
+/// Uma entrada do cache de ToA, contendo apenas os parâmetros que afetam o
+/// tempo de transmissão.
+struct _radio_toa_entry_t {
+    bool valid;
+    float bandwidth;
+    uint16_t preambleLength;
+    uint8_t sf;
+    uint8_t cr;
+    bool crc;
+    bool implicitHeader;
+    uint32_t length;
+    uint64_t toa;
+};
+
+static struct {
+    _radio_toa_entry_t entries[RADIO_TOA_CACHE_SIZE];
+
+    /// Índice da próxima entrada a ser substituída.
+    uint8_t next;
+} _radioToaCache;
+
+portMUX_TYPE _radioToaLock = portMUX_INITIALIZER_UNLOCKED;
+
+/// Calcula o tempo de transmissão, em microsegundos, usando aritmética
+/// inteira de acordo com a seção 6.1.4 do datasheet do SX1262 (o mesmo cálculo
+/// de `SX126x::getTimeOnAir` da RadioLib). Ao contrário da RadioLib, não
+/// depende dos parâmetros aplicados atualmente no radiotransmissor.
+uint64_t _radioComputeTransmitTime(const radio_parameters_t& param,
+                                   uint32_t packetLength) {
+    const uint32_t symbolLength =
+        ((uint32_t)(1000 * 10) << param.sf) / (param.bandwidth * 10);
+
+    // Algumas constantes possuem .25, logo são multiplicadas por 4
+    uint8_t sfCoeff1_x4 = 17;
+    uint8_t sfCoeff2 = 8;
+    if (param.sf == 5 || param.sf == 6) {
+        sfCoeff1_x4 = 25;
+        sfCoeff2 = 0;
+    }
+
+    // O `low data rate optimization` é ligado por `autoLDRO` em símbolos
+    // com mais de 16ms
+    uint8_t sfDivisor = 4 * param.sf;
+    if (symbolLength >= 16000)
+        sfDivisor = 4 * (param.sf - 2);
+
+    int32_t bitCount = (int32_t)8 * packetLength + (param.crc ? 16 : 0) -
+                       4 * param.sf + sfCoeff2 +
+                       (param.packetLength > 0 ? 0 : 20);
+    if (bitCount < 0)
+        bitCount = 0;
+
+    const uint32_t preCodedSymbols = (bitCount + (sfDivisor - 1)) / sfDivisor;
+    const uint64_t symbols_x4 = (param.preambleLength + 8) * 4 + sfCoeff1_x4 +
+                                preCodedSymbols * param.cr * 4;
+
+    return (symbolLength * symbols_x4) / 4;
+}
+
+/// Retorna o tempo esperado de transmissão, em microsegundos, dados
+/// os parâmetros definidos e o comprimento do pacote a ser medido.
+///
+/// O resultado é armazenado em um cache, logo apenas a primeira chamada para
+/// cada combinação de parâmetros calcula o tempo de transmissão.
+uint64_t radioTransmitTime(const radio_parameters_t& param,
+                           uint32_t packetLength) {
+    const _radio_toa_entry_t key = {
+        .valid = true,
+        .bandwidth = param.bandwidth,
+        .preambleLength = param.preambleLength,
+        .sf = param.sf,
+        .cr = param.cr,
+        .crc = param.crc,
+        .implicitHeader = param.packetLength > 0,
+        .length = packetLength,
+        .toa = 0,
+    };
+
+    portENTER_CRITICAL(&_radioToaLock);
+
+    for (size_t i = 0; i < RADIO_TOA_CACHE_SIZE; i++) {
+        const _radio_toa_entry_t& entry = _radioToaCache.entries[i];
+
+        if (entry.valid && entry.bandwidth == key.bandwidth &&
+            entry.preambleLength == key.preambleLength &&
+            entry.sf == key.sf && entry.cr == key.cr &&
+            entry.crc == key.crc &&
+            entry.implicitHeader == key.implicitHeader &&
+            entry.length == key.length) {
+            const uint64_t toa = entry.toa;
+            portEXIT_CRITICAL(&_radioToaLock);
+            return toa;
+        }
+    }
+
+    portEXIT_CRITICAL(&_radioToaLock);
+
+    // Calcular fora da seção crítica e substituir a entrada mais antiga
+    _radio_toa_entry_t entry = key;
+    entry.toa = _radioComputeTransmitTime(param, packetLength);
+
+    portENTER_CRITICAL(&_radioToaLock);
+    _radioToaCache.entries[_radioToaCache.next] = entry;
+    _radioToaCache.next = (_radioToaCache.next + 1) % RADIO_TOA_CACHE_SIZE;
+    portEXIT_CRITICAL(&_radioToaLock);
+
+    return entry.toa;
+}
@@ -0,0 +1,65 @@
+/**
+ * hal/spsc.hh
+ *
+ * Fila circular sem locks para um único produtor e um único consumidor,
+ * permitindo que tasks em núcleos diferentes troquem dados sem bloquear.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/// Fila de capacidade fixa `N`, que deve ser uma potência de 2. Apenas uma
+/// task pode chamar `push` e apenas uma task pode chamar `pop`.
+template <typename T, size_t N>
+struct spsc_queue_t {
+    static_assert(N > 0 && (N & (N - 1)) == 0,
+                  "A capacidade da fila deve ser uma potência de 2");
+
+    T items[N];
+
+    /// Índices livres de overflow: a posição real é o índice módulo `N`.
+    std::atomic<uint32_t> head { 0 };
+    std::atomic<uint32_t> tail { 0 };
+
+    /// Insere um item no final da fila. Retorna `false` caso a fila esteja
+    /// cheia. Deve ser executado apenas pelo produtor.
+    bool push(const T& item) {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+
+        items[t % N] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Remove o item no início da fila, copiando-o para `*item`. Retorna
+    /// `false` caso a fila esteja vazia. Deve ser executado apenas pelo
+    /// consumidor.
+    bool pop(T* item) {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+
+        *item = items[h % N];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Retorna a quantidade de itens na fila.
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) -
+               head.load(std::memory_order_acquire);
+    }
+
+    /// Retorna `true` caso a fila esteja vazia.
+    bool empty() const {
+        return size() == 0;
+    }
+};
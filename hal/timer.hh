@@ -5,14 +5,40 @@
  * o transmissor no experimento.
  */
 
+#include "esp_sleep.h"
 #include "esp_timer.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "probe.hh"
+
+/// Executa `_timerCallback` diretamente no interrupt do alarme, em vez da
+/// task do `esp_timer`, acordando a task do timer com uma única troca de
+/// contexto. Disponível apenas caso o ESP-IDF tenha sido configurado com
+/// `CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD`, o que exige um sdkconfig
+/// próprio (ex. compilando as bibliotecas do core com o
+/// `esp32-arduino-lib-builder`), já que o sdkconfig padrão do core 2.0.17
+/// não deve habilitar a opção.
+#ifdef CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define TIMER_ISR_DISPATCH
+#else
+// Sem a opção, o callback executa na task do `esp_timer`, que então acorda a
+// task do timer, com uma troca de contexto a mais em cada slot
+#endif
 
 using timer_handler_fn = void (*)(void);
 
-/// A task do FreeRTOS que lida com o timeout do timer.
+/// A task do FreeRTOS que lida com o timeout do timer. Criada uma única vez em
+/// `timerInit`.
 TaskHandle_t _timerTask = NULL;
 
+/// `true` enquanto o timer estiver ativo. Impede que a função do usuário
+/// seja executada por um timeout pendente após `timerStop`.
+volatile bool _timerRunning = false;
+
+/// Mantido pela task do timer enquanto a função do usuário executa, para que
+/// `timerStop` aguarde o fim da execução atual.
+SemaphoreHandle_t _timerUserLock = NULL;
+
 /// Função do usuário, definida em `timerStart` e `timerResync`
 timer_handler_fn _timerUserFn = NULL;
 
@@ -22,10 +48,37 @@ volatile esp_timer_handle_t _timerHandle;
 volatile uint64_t _timerNextPeriod = 0;
 timer_handler_fn _timerNextUserFn = NULL;
 
-/// Chamado quando o tempo definido no timer passar.
+/// O período atual do timer, sem os ajustes de `timerNudge`.
+volatile uint64_t _timerBasePeriod = 0;
+
+/// O período que começou no último timeout, incluindo o ajuste de
+/// `timerNudge`.
+volatile uint64_t _timerPeriodApplied = 0;
+
+/// O instante absoluto, em microsegundos, do próximo timeout. O timer é de
+/// disparo único e é rearmado a cada timeout para este instante, de forma
+/// que a latência do callback não se acumula nos períodos seguintes.
+volatile int64_t _timerDeadline = 0;
+
+/// Ajuste, em microsegundos, aplicado uma única vez ao próximo período.
+volatile int64_t _timerNudge = 0;
+
+/// O instante, em microsegundos, da última execução de `_timerCallback` e da
+/// task do timer ao ser notificada por ela.
+volatile int64_t _timerCallbackTime = 0;
+volatile int64_t _timerResumeTime = 0;
+
+/// Chamado quando o tempo definido no timer passar. Com `TIMER_ISR_DISPATCH`,
+/// executa no interrupt do alarme, logo deve permanecer na IRAM e usar apenas
+/// funções seguras para interrupts.
+#ifdef TIMER_ISR_DISPATCH
+IRAM_ATTR
+#endif
 void _timerCallback(void* _) {
+    _timerCallbackTime = esp_timer_get_time();
+
     if (_timerNextPeriod > 0) {
-        esp_timer_restart(_timerHandle, _timerNextPeriod);
+        _timerBasePeriod = _timerNextPeriod;
         _timerNextPeriod = 0;
         
         // Muda o callback do usuário caso necessário.
@@ -35,17 +88,45 @@ void _timerCallback(void* _) {
         }
     }
 
+    // Aplicar o ajuste em apenas um período, voltando ao período original
+    // no próximo timeout
+    const int64_t nudged = (int64_t)_timerBasePeriod + _timerNudge;
+    const uint64_t period = nudged > 0 ? nudged : _timerBasePeriod;
+    _timerNudge = 0;
+
+    // O próximo timeout é relativo ao instante nominal deste, e não ao
+    // instante em que o callback executou
+    _timerPeriodApplied = period;
+    _timerDeadline += period;
+
+    // Não rearmar um timer parado por `timerStop`
+    const int64_t remaining = _timerDeadline - esp_timer_get_time();
+    if (_timerRunning)
+        esp_timer_start_once(_timerHandle, remaining > 0 ? remaining : 1);
+
     // Notifica a task para executar o callback do usuario.
-    vTaskNotifyGiveFromISR(_timerTask, NULL);
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(_timerTask, &woken);
+
+#ifdef TIMER_ISR_DISPATCH
+    // Trocar para a task do timer assim que o interrupt terminar
+    if (woken == pdTRUE)
+        esp_timer_isr_dispatch_need_yield();
+#endif
 }
 
 // Executa o callback do usuario apos ser notificado.
 void _timerHandlerTask(void* _) {
     while (1) {
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _timerResumeTime = esp_timer_get_time();
 
         // Executa a função de timeout do usuario.
-        (_timerUserFn)();
+        xSemaphoreTake(_timerUserLock, portMAX_DELAY);
+        if (_timerRunning)
+            (_timerUserFn)();
+        xSemaphoreGive(_timerUserLock);
+
         yield();
     }
 }
@@ -55,30 +136,42 @@ void timerInit() {
     const esp_timer_create_args_t args = {
         .callback = &_timerCallback,
         .arg = NULL,
+#ifdef TIMER_ISR_DISPATCH
+        .dispatch_method = ESP_TIMER_ISR,
+#else
+        .dispatch_method = ESP_TIMER_TASK,
+#endif
         .name = "sync",
     };
 
+    _timerUserLock = xSemaphoreCreateMutex();
+
     // Criar o timer periódico
     ESP_ERROR_CHECK(
         esp_timer_create(&args, (esp_timer_handle_t*)&_timerHandle));
+
+    // Cria uma task no mesmo nucleo que a funcao foi executada.
+    // A task irá esperar o próximo timeout do timer e executará
+    // a função do usuário.
+    xTaskCreatePinnedToCore(_timerHandlerTask, "timer_handler", 8192, NULL,
+                tskIDLE_PRIORITY + 10, &_timerTask, xPortGetCoreID());
 }
 
 /// Inicia o timer periódico com um timeout definido em microsegundos.
 /// Quando ocorrer um timeout, a função passada no parâmetro `fn` será
 /// executada.
 void timerStart(uint64_t micro, timer_handler_fn fn) {
-    if (_timerTask != NULL)
-        vTaskDelete(_timerTask);
-    
-    _timerUserFn = fn;
+    // Reiniciar o timer caso ele já esteja ativo
+    esp_timer_stop(_timerHandle);
 
-    // Cria uma task no mesmo nucleo que a funcao foi executada.
-    // A task irá esperar o próximo timeout do timer e executará
-    // a função do usuário.
-    xTaskCreatePinnedToCore(_timerHandlerTask, "timer_handler", 8192, NULL,
-                tskIDLE_PRIORITY + 10, &_timerTask, xPortGetCoreID());
+    _timerUserFn = fn;
+    _timerBasePeriod = _timerPeriodApplied = micro;
+    _timerNextPeriod = 0;
+    _timerNudge = 0;
+    _timerDeadline = esp_timer_get_time() + micro;
+    _timerRunning = true;
 
-    ESP_ERROR_CHECK(esp_timer_start_periodic(_timerHandle, micro));
+    ESP_ERROR_CHECK(esp_timer_start_once(_timerHandle, micro));
 }
 
 /// Marca o timer para resincronização. No próximo tick do timer, o timeout irá
@@ -88,29 +181,68 @@ void timerResync(uint64_t micro, timer_handler_fn fn) {
     _timerNextUserFn = fn;
 }
 
+/// Ajusta apenas o próximo período do timer em `micro` microsegundos,
+/// deslocando todos os timeouts seguintes sem alterar o período. Usado para
+/// corrigir o desvio entre os relógios de dois aparelhos.
+void timerNudge(int64_t micro) {
+    _timerNudge = micro;
+}
+
+/// Retorna o atraso, em microsegundos, entre o último timeout do timer e o
+/// início da execução da função do usuário.
+int64_t timerLatency() {
+    return _timerResumeTime - _timerCallbackTime;
+}
+
 /// Retorna o tempo atual no timer.
 int64_t timerTime() {
     return esp_timer_get_time();
 }
 
-/// Retorna o período (ou timeout) do timer.
+/// Retorna o período (ou timeout) do timer que começou no último tick.
 uint64_t timerPeriod() {
-    uint64_t period = 0;
-
-    ESP_ERROR_CHECK(esp_timer_get_period(_timerHandle, &period));
-
-    return period;
+    return _timerPeriodApplied;
 }
 
 /// Retorna o tempo absoluto, em microsegundos, do próximo tick do timer.
 int64_t timerNextTick() {
-    return esp_timer_get_next_alarm();
+    return _timerDeadline;
 }
 
-/// Finaliza o timer periódico.
+/// Finaliza o timer periódico. Quando executado por outra task, aguarda o
+/// fim da execução atual da função do usuário, de forma que ela não acesse
+/// mais o radiotransmissor nem o log após o retorno. Pode ser executado pela
+/// própria função do usuário, pois a task do timer não é finalizada.
 void timerStop() {
-    if (_timerTask != NULL)
-        vTaskDelete(_timerTask);
+    _timerRunning = false;
+    esp_timer_stop(_timerHandle);
+
+    if (xTaskGetCurrentTaskHandle() == _timerTask)
+        return;
+
+    xSemaphoreTake(_timerUserLock, portMAX_DELAY);
+    xSemaphoreGive(_timerUserLock);
+}
 
-    ESP_ERROR_CHECK(esp_timer_stop(_timerHandle));
-}
\ No newline at end of file
+/// Tempo mínimo, em microsegundos, até o instante de acordar para que
+/// `timerLightSleep` entre em light sleep.
+#define TIMER_SLEEP_MIN 2000
+
+/// Coloca o ESP32 em light sleep até `early` microsegundos antes do próximo
+/// tick do timer. Deve ser executado pela função do usuário, sem operações
+/// pendentes nos periféricos, já que ambos os núcleos são pausados. Retorna
+/// `false` caso o tempo até o tick seja curto demais para dormir.
+bool timerLightSleep(int64_t early) {
+    const int64_t wake = timerNextTick() - early;
+    const int64_t remaining = wake - esp_timer_get_time();
+
+    if (remaining < TIMER_SLEEP_MIN)
+        return false;
+
+    esp_sleep_enable_timer_wakeup(remaining);
+    esp_light_sleep_start();
+
+    // O relógio do `esp_timer` é compensado após o light sleep
+    probeRecord(kProbeCpuWake, esp_timer_get_time() - wake);
+    return true;
+}
@@ -10,12 +10,38 @@
 #include <SSD1306Wire.h>
 
 #include "buttons.hh"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "lib.hh"
+#include "probe.hh"
 
 /// Define três tipos de alinhamento diferentes.
 enum alignment_t { kLeft, kCenter, kRight };
 
-SSD1306Wire display(0x3c, SDA_OLED, SCL_OLED, GEOMETRY_128_64);
+/// O endereço I2C e as dimensões do OLED.
+#define UI_OLED_ADDRESS 0x3c
+#define UI_WIDTH 128
+#define UI_HEIGHT 64
+
+/// Quantidade de páginas do OLED. Cada página contém 8 linhas, com um byte
+/// por coluna.
+#define UI_PAGES (UI_HEIGHT / 8)
+
+SSD1306Wire display(UI_OLED_ADDRESS, SDA_OLED, SCL_OLED, GEOMETRY_128_64);
+
+static struct {
+    /// Cópia do último frame enviado ao OLED, usada para enviar apenas as
+    /// regiões modificadas.
+    uint8_t frame[UI_WIDTH * UI_PAGES];
+
+    /// `false` caso o conteúdo do OLED seja desconhecido, forçando o envio
+    /// do frame completo.
+    bool valid;
+
+    /// O instante em que o frame atual começou a ser desenhado.
+    int64_t frameStart;
+} _uiDisplayState;
 
 enum color_t { kWhite, kBlack, kInvert };
 
@@ -72,6 +98,8 @@ bool uiSetup() {
     display.flipScreenVertically();
     display.setFont(ArialMT_Plain_10);
 
+    _uiDisplayState.valid = false;
+
     _uiState = {};
     _uiState.selection = 0;
     _uiState.wasPressed = false;
@@ -103,6 +131,7 @@ void uiLoop() {
 
 /// Limpa a tela da interface, preparando um novo frame.
 void uiClear() {
+    _uiDisplayState.frameStart = probeNow();
     display.clear();
 }
 
@@ -175,6 +204,55 @@ bool uiButton(int16_t x, int16_t y, const String& text,
     return pressed;
 }
 
+/// Preenche o retângulo dado com o padrão pontilhado, em que apenas os
+/// pixels com ambas as coordenadas ímpares (relativas ao retângulo) não são
+/// desenhados. Escreve diretamente no framebuffer, uma página por vez, em
+/// vez de desenhar cada pixel com `setPixel`.
+void _uiDither(int16_t x, int16_t y, int32_t w, int32_t h, color_t color) {
+    int32_t x0 = x < 0 ? 0 : x;
+    int32_t x1 = x + w > UI_WIDTH ? UI_WIDTH : x + w;
+    int32_t y0 = y < 0 ? 0 : y;
+    int32_t y1 = y + h > UI_HEIGHT ? UI_HEIGHT : y + h;
+
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    for (int32_t page = y0 / 8; page <= (y1 - 1) / 8; page++) {
+        // Linhas do retângulo nesta página, e apenas as linhas pares
+        uint8_t full = 0;
+        uint8_t even = 0;
+
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            const int32_t row = page * 8 + bit;
+
+            if (row < y0 || row >= y1)
+                continue;
+
+            full |= 1 << bit;
+            if ((row - y) % 2 == 0)
+                even |= 1 << bit;
+        }
+
+        uint8_t* buffer = display.buffer + page * UI_WIDTH;
+
+        for (int32_t col = x0; col < x1; col++) {
+            const uint8_t mask = (col - x) % 2 == 0 ? full : even;
+
+            switch (color) {
+            case kWhite:
+                buffer[col] |= mask;
+                break;
+            case kBlack:
+                buffer[col] &= ~mask;
+                break;
+            case kInvert:
+                buffer[col] ^= mask;
+                break;
+            }
+        }
+    }
+}
+
 enum rect_type_t {
     kFill,
     kStroke,
@@ -195,12 +273,7 @@ void uiRect(int16_t x, int16_t y, uint16_t w, uint16_t h,
         display.drawRect(x, y, w, h);
         break;
     case kDither:
-        for (uint16_t yo = 0; yo < h; yo++) {
-            for (uint16_t xo = 0; xo < w; xo++) {
-                if (xo % 2 != 1 || yo % 2 != 1)
-                    display.setPixel(x + xo, y + yo);
-            }
-        }
+        _uiDither(x, y, w, h, color);
         break;
     }
 }
@@ -215,7 +288,134 @@ void uiCheckbox(int16_t x, int16_t y, bool filled, color_t color = kInvert) {
         display.fillRect(x + 2, y + 2, 4, 4);
 }
 
+/// Envia um comando ao controlador do OLED, da mesma forma que
+/// `SSD1306Wire`.
+void _uiCommand(uint8_t command) {
+    Wire.beginTransmission(UI_OLED_ADDRESS);
+    Wire.write(0x80);
+    Wire.write(command);
+    Wire.endTransmission();
+}
+
+/// Envia ao OLED as colunas `x0` a `x1` (inclusivo) da página dada.
+void _uiSendPage(uint8_t page, uint8_t x0, uint8_t x1) {
+    _uiCommand(COLUMNADDR);
+    _uiCommand(x0);
+    _uiCommand(x1);
+    _uiCommand(PAGEADDR);
+    _uiCommand(page);
+    _uiCommand(page);
+
+    const uint8_t* buffer = display.buffer + page * UI_WIDTH;
+
+    // Enviar em blocos de 16 bytes, como a biblioteca do display
+    for (uint16_t x = x0; x <= x1; x += 16) {
+        Wire.beginTransmission(UI_OLED_ADDRESS);
+        Wire.write(0x40);
+
+        for (uint16_t i = x; i <= x1 && i < x + 16; i++)
+            Wire.write(buffer[i]);
+
+        Wire.endTransmission();
+    }
+}
+
 /// Finaliza o frame atual e desenha a interface no OLED.
+///
+/// Apenas as colunas modificadas de cada página são enviadas pelo I2C, e o
+/// envio é pulado caso o frame seja idêntico ao anterior.
 void uiFinish() {
-    display.display();
-}
\ No newline at end of file
+    if (!_uiDisplayState.valid) {
+        display.display();
+        memcpy(_uiDisplayState.frame, display.buffer,
+               sizeof(_uiDisplayState.frame));
+        _uiDisplayState.valid = true;
+        probeSince(kProbeUiFrame, _uiDisplayState.frameStart);
+        return;
+    }
+
+    for (uint8_t page = 0; page < UI_PAGES; page++) {
+        const uint8_t* current = display.buffer + page * UI_WIDTH;
+        uint8_t* last = _uiDisplayState.frame + page * UI_WIDTH;
+
+        // Encontrar as colunas modificadas nesta página
+        int16_t x0 = 0;
+        while (x0 < UI_WIDTH && current[x0] == last[x0])
+            x0++;
+
+        if (x0 == UI_WIDTH)
+            continue;
+
+        int16_t x1 = UI_WIDTH - 1;
+        while (current[x1] == last[x1])
+            x1--;
+
+        _uiSendPage(page, x0, x1);
+        memcpy(last + x0, current + x0, x1 - x0 + 1);
+    }
+
+    probeSince(kProbeUiFrame, _uiDisplayState.frameStart);
+}
+
+/// Função que desenha um frame completo da interface, de `uiLoop` até
+/// `uiFinish`.
+using ui_render_fn = void (*)(void);
+
+static struct {
+    /// A task que desenha a interface periodicamente.
+    TaskHandle_t task;
+
+    /// Impede que a task seja finalizada no meio de um frame.
+    SemaphoreHandle_t lock;
+
+    /// Função do usuário e intervalo entre os frames, em ticks.
+    ui_render_fn render;
+    TickType_t interval;
+} _uiTaskState;
+
+void _uiTaskLoop(void* _) {
+    TickType_t last = xTaskGetTickCount();
+
+    while (1) {
+        vTaskDelayUntil(&last, _uiTaskState.interval);
+
+        xSemaphoreTake(_uiTaskState.lock, portMAX_DELAY);
+        _uiTaskState.render();
+        xSemaphoreGive(_uiTaskState.lock);
+    }
+}
+
+/// Inicia uma task de baixa prioridade, no núcleo oposto ao atual, que
+/// executa `fn` a cada frame com a taxa dada. Enquanto a task estiver
+/// ativa, nenhuma outra task deve desenhar na interface.
+///
+/// Desta forma, o envio do frame ao OLED pelo I2C nunca atrasa as tasks do
+/// núcleo atual, como as do timer e do radiotransmissor.
+void uiTaskStart(ui_render_fn fn, uint32_t fps) {
+    if (_uiTaskState.task != NULL)
+        return;
+
+    if (_uiTaskState.lock == NULL)
+        _uiTaskState.lock = xSemaphoreCreateMutex();
+
+    _uiTaskState.render = fn;
+    _uiTaskState.interval = pdMS_TO_TICKS(1000 / fps);
+
+    if (_uiTaskState.interval == 0)
+        _uiTaskState.interval = 1;
+
+    xTaskCreatePinnedToCore(_uiTaskLoop, "ui", 8192, NULL,
+                            tskIDLE_PRIORITY + 1, &_uiTaskState.task,
+                            xPortGetCoreID() == 0 ? 1 : 0);
+}
+
+/// Finaliza a task da interface, aguardando o fim do frame atual.
+void uiTaskStop() {
+    if (_uiTaskState.task == NULL)
+        return;
+
+    xSemaphoreTake(_uiTaskState.lock, portMAX_DELAY);
+    vTaskDelete(_uiTaskState.task);
+    _uiTaskState.task = NULL;
+    xSemaphoreGive(_uiTaskState.lock);
+}
@@ -1,49 +1,191 @@
+#include <Preferences.h>
+
 #include "hal/buttons.hh"
 #include "hal/lib.hh"
 #include "hal/log.hh"
+#include "hal/probe.hh"
 #include "hal/radio.hh"
+#include "hal/spsc.hh"
 #include "hal/timer.hh"
 #include "hal/ui.hh"
+#include "energy.hh"
+#include "packet.hh"
+#include "schedule.hh"
+#include "stats.hh"
+
+#ifdef LOOPBACK
+#include "hal/radio_aux.hh"
+#endif
 
 /// Ao receber mensagens em parâmetros com mensagens demoradas, o receptor
 /// possui um delay variável, cuja fonte não pude verificar ainda. Nos
 /// parâmetros mais demorados, com 62.5kHz e SF12, o delay máximo reportado foi
-/// de 50-60ms, mas em geral parece ser +-3% do time on air.
-#define RX_TIMING_ERROR 55000
-
-/// O delay aguardado antes de iniciar o relógio do transmissor
-#define TX_DELAY (RX_TIMING_ERROR + 8000)
-
-/// A quantidade de tempo, em microsegundos, disponibilizado para qualquer
-/// processamento além do experimento principal.
-#define BUDGET (TX_DELAY + 80000)
-
-/// A quantidade de tempo, em microsegundos, reservado apenas para escrita no
-/// cartão SD.
-#define SD_BUDGET 2000000
+/// de 50-60ms, mas em geral parece ser +-3% do time on air
+/// (`LORA_EXCESS_PERMILLE`). O erro da sincronização inicial é este delay na
+/// recepção do pacote de sincronização, logo o atraso do transmissor é
+/// calculado pelo ToA deste pacote (ver `syncTxDelay`), somado a
+/// `SYNC_GUARD` microsegundos.
+#define SYNC_GUARD 8000
+
+/// O atraso do fim da operação LoRa além do ToA, em partes por mil do ToA.
+/// Corresponde ao delay variável de +-3% do ToA observado no receptor.
+#define LORA_EXCESS_PERMILLE 30
+
+/// A quantidade de tempo, em microsegundos, reservado para o processamento
+/// após o fim da operação LoRa em cada slot.
+#define PROCESSING_BUDGET 15000
+
+/// Margem de segurança, em microsegundos, adicionada ao período de cada slot.
+#define SLOT_MARGIN 10000
+
+/// Intervalo, em millisegundos, entre o pacote de configuração e o pacote de
+/// sincronização, para que o receptor possa voltar a receber.
+#define SYNC_GAP 50
+
+/// A cada `SYNC_BEACON_INTERVAL` testes, o transmissor reenvia a
+/// configuração e o pacote de sincronização em um slot próprio, para que um
+/// receptor reiniciado durante o experimento volte a participar dele.
+#define SYNC_BEACON_INTERVAL 8
+
+/// Quantidade de testes seguidos sem nenhuma mensagem recebida após a qual o
+/// receptor volta a esperar a sincronização, por exemplo após uma
+/// reinicialização do transmissor. Combinações fora do alcance também contam,
+/// e nesse caso o receptor perde no máximo os testes até o próximo beacon.
+#define SYNC_LOST_TESTS 4
+
+/// A quantidade de tempo, em microsegundos, reservado para reconfigurar o
+/// radiotransmissor entre duas combinações de parâmetros. A escrita no cartão
+/// SD é feita em paralelo pela task do datalogger.
+#define RECONFIG_BUDGET 20000
+
+/// O receptor corrige, a cada mensagem recebida, 1/DRIFT_GAIN do desvio
+/// medido entre o seu relógio e o do transmissor.
+#define DRIFT_GAIN 4
+
+/// Correção máxima, em microsegundos, aplicada ao relógio do receptor em um
+/// único slot.
+#define DRIFT_MAX_STEP 2000
+
+/// Modo de baixo consumo, para aparelhos alimentados por bateria: entre as
+/// mensagens, o radiotransmissor dorme com warm start e o ESP32 entra em
+/// light sleep até `WAKEUP_BUDGET` microsegundos antes do próximo slot, que
+/// são reservados para acordar e preparar a próxima mensagem. A interface não
+/// é desenhada durante o experimento.
+// #define LOW_POWER
+
+#ifdef LOW_POWER
+#define WAKEUP_BUDGET 8000
+#else
+#define WAKEUP_BUDGET 0
+#endif
+
+/// Modo sem interface, para aparelhos instalados sem operador: o OLED não é
+/// inicializado, e a sincronização começa logo após o boot, com o cargo lido
+/// de `ROLE_FILENAME` ou da memória não volátil. Sem um cargo configurado, o
+/// menu é exibido, e o cargo escolhido é gravado para os próximos boots.
+// #define HEADLESS
+
+/// Modo de loopback, para testes de regressão em bancada com um único
+/// aparelho: um segundo SX1262, ligado ao barramento do cartão SD (ver
+/// `hal/radio_aux.hh`), recebe em uma task no outro núcleo as mensagens
+/// enviadas pelo radiotransmissor da placa, percorrendo todo o cronograma
+/// padrão. Os dois radios devem estar ligados por um cabo com atenuador ou
+/// por antenas de carga. O cartão SD e o menu não são usados, e o resultado
+/// de cada teste é impresso no Serial.
+// #define LOOPBACK
+
+/// A taxa de quadros da interface durante o experimento.
+#define UI_FRAME_RATE 8
 
 /// Define a quantidade de mensagens enviadas para cada combinação de
 /// parâmetros.
 #define MESSAGES_PER_TEST 50
 
-/// A mensagem enviada durante o experimento.
-uint8_t _message[] = "XMensagem";
-const uint8_t _messageLength = sizeof(_message) / sizeof(char);
+/// No modo adaptativo, o teste é encerrado quando a largura do intervalo de
+/// confiança de 95% do PER for no máximo ADAPTIVE_MAX_WIDTH.
+#define ADAPTIVE_MAX_WIDTH 0.2f
+#define ADAPTIVE_Z 1.96f
+
+/// Arquivo no cartão SD com a descrição do cronograma do experimento.
+#define SCHEDULE_FILENAME "/schedule.txt"
+
+/// Arquivo opcional no cartão SD do receptor com o identificador do aparelho,
+/// que é então gravado na memória não volátil.
+#define NODE_FILENAME "/node.txt"
+
+/// Arquivo opcional no cartão SD com o cargo do modo sem interface ("tx" ou
+/// "rx"), que é então gravado na memória não volátil. Qualquer outro conteúdo
+/// apaga o cargo gravado, voltando ao menu.
+#define ROLE_FILENAME "/role.txt"
+
+/// O comprimento padrão da mensagem enviada durante o experimento.
+const uint8_t _messageLength = sizeof(_packetPattern) / sizeof(char);
+
+/// O comprimento da mensagem na combinação de parâmetros atual.
+uint8_t _payloadLength = _messageLength;
 bool _hasSD = false;
 
-/// Determina o índice do teste atual. Usado para calcular o
-/// SF, CR, largura de banda e potência de transmissão do teste.
+/// O identificador deste aparelho, gravado na memória não volátil. Determina
+/// o slot em que o receptor envia o resumo de cada teste ao transmissor.
+uint8_t _nodeId = 0;
+Preferences _preferences;
+
+/// Determina o índice do teste atual na tabela `_schedule`.
 uint32_t _currentTest = 0;
 
+/// O identificador do cronograma atual (ver `scheduleHash`). O transmissor
+/// grava, na memória não volátil, o identificador e o próximo teste ao fim
+/// de cada teste, para retomar o cronograma após uma reinicialização.
+uint32_t _sweepId = 0;
+
+/// A descrição do cronograma do experimento. O transmissor a substitui pelo
+/// arquivo `SCHEDULE_FILENAME`, caso exista, e o receptor pela descrição
+/// recebida na sincronização.
+schedule_spec_t _scheduleSpec = scheduleDefault(_messageLength);
+
+/// O ToA, em microsegundos, da mensagem na combinação de parâmetros atual.
+/// Calculado uma única vez por `updateTestParameters`.
+uint64_t _toa = 0;
+
+/// Os ToAs, em microsegundos, dos pacotes de controle, para que os slots não
+/// consultem o cache de `radioTransmitTime`. Os da sincronização não mudam e
+/// são calculados em `setup`, e os do feedback e do resumo, que usam os
+/// parâmetros do teste, por `updateTestParameters`.
+static struct {
+    uint64_t syncHeader;
+    uint64_t syncSpec;
+    uint64_t syncMark;
+    uint64_t feedback;
+    uint64_t summary;
+} _controlToa;
+
 /// Contagem de pacotes recebidos com sucesso, corruptos ou perdidos.
 uint32_t _testsOk = 0;
 uint32_t _testsCorrupt = 0;
 uint32_t _testsLost = 0;
 
-/// Define os parâmetros atuais da transmissão.
-/// Os parâmetros iniciais serão utilizados na sincronização inicial
-/// dos dispositivos.
-radio_parameters_t _parameters = radio_parameters_t {
+/// Estatísticas do teste atual, enviadas ao transmissor no fim do teste.
+struct test_stats_t {
+    uint16_t ok;
+    uint16_t corrupt;
+    uint16_t lost;
+
+    /// RSSI e SNR das mensagens recebidas com sucesso.
+    running_stats_t rssi;
+    running_stats_t snr;
+    uint16_t rssiHistogram[STATS_BUCKETS];
+    uint16_t snrHistogram[STATS_BUCKETS];
+
+    /// Energia, em joules, das operações LoRa do teste.
+    float energy;
+} _testStats = {};
+
+static_assert(STATS_BUCKETS == LOG_HISTOGRAM_BUCKETS,
+              "Os histogramas não cabem no registro de resumo");
+
+/// Os parâmetros da sincronização inicial dos dispositivos, os mais
+/// robustos.
+const radio_parameters_t _syncParameters = radio_parameters_t {
     .power = 22,
     .frequency = 915.0,
     .preambleLength = 8,
@@ -57,12 +199,228 @@ radio_parameters_t _parameters = radio_parameters_t {
     .syncWord = 0xAE,
 };
 
-/// Define o cargo atual deste aparelho.
+/// Os parâmetros usados para enviar a descrição do cronograma na
+/// sincronização, mais rápidos que os de `_syncParameters`, já que a
+/// descrição é longa e o receptor que já a conhece não precisa recebê-la.
+const radio_parameters_t _specParameters = radio_parameters_t {
+    .power = 22,
+    .frequency = 915.0,
+    .preambleLength = 8,
+    .bandwidth = 125.0,
+    .sf = 9,
+    .cr = 8,
+    .crc = true,
+    .invertIq = false,
+    .boostedRxGain = true,
+    .packetLength = 0,
+    .syncWord = 0xAE,
+};
+
+/// Os parâmetros do pacote de sincronização, cujo fim determina o início do
+/// relógio dos receptores. Com a largura de banda maior, o ToA do pacote, e
+/// portanto o erro da sincronização e o atraso do transmissor em cada slot,
+/// são 8 vezes menores que com `_syncParameters`, com o mesmo SF.
+const radio_parameters_t _markParameters = radio_parameters_t {
+    .power = 22,
+    .frequency = 915.0,
+    .preambleLength = 8,
+    .bandwidth = 500.0,
+    .sf = 12,
+    .cr = 8,
+    .crc = true,
+    .invertIq = false,
+    .boostedRxGain = true,
+    .packetLength = 0,
+    .syncWord = 0xAE,
+};
+
+/// Define os parâmetros atuais da transmissão.
+radio_parameters_t _parameters = _syncParameters;
+
+/// Os cargos possíveis deste aparelho.
 enum role_t {
     kUnspecified,
     kTx,
     kRx,
-} _role = kUnspecified;
+};
+
+/// Com `ROLE_TX` ou `ROLE_RX` definidos na compilação, o cargo é fixo: o menu
+/// de seleção e o modo ping não são compilados, e as verificações do cargo
+/// são resolvidas pelo compilador, removendo o código do outro cargo. Por
+/// exemplo, um receptor é compilado com a opção `--build-property` do
+/// `arduino-cli` igual a `compiler.cpp.extra_flags=-DROLE_RX`. O mesmo vale
+/// para `LOW_POWER` e `LOG_NO_SD` (ver `hal/log.hh`).
+#if defined(ROLE_TX) && defined(ROLE_RX)
+#error "Apenas um de ROLE_TX e ROLE_RX pode ser definido"
+#elif defined(ROLE_TX) || defined(ROLE_RX)
+#define FIXED_ROLE
+#endif
+
+/// Define o cargo atual deste aparelho.
+#if defined(ROLE_TX)
+constexpr role_t _role = kTx;
+#elif defined(ROLE_RX)
+constexpr role_t _role = kRx;
+#else
+role_t _role = kUnspecified;
+#endif
+
+/// `true` caso o OLED tenha sido inicializado. No modo sem interface, nada é
+/// desenhado e o botão é lido por `loop`.
+bool _uiEnabled = false;
+
+/// Instante, em microsegundos desde o boot, do início da primeira tentativa
+/// de sincronização.
+int64_t _bootSyncStart = -1;
+
+/// Modelo usado para calcular o período de cada slot a partir do ToA da
+/// combinação atual. Todos os tempos estão em microsegundos.
+///
+/// Os campos estão ordenados pelo alinhamento, pois a estrutura é enviada
+/// dentro de `sync_header_t` sem ser empacotada.
+struct slot_timing_t {
+    /// Atraso do transmissor em relação ao receptor, cobrindo o erro da
+    /// sincronização inicial. Pago em todos os slots, já que o atraso é
+    /// fixado na sincronização.
+    uint32_t txDelay;
+
+    /// Tempo reservado para o processamento após a operação LoRa.
+    uint32_t processing;
+
+    /// Margem de segurança adicionada ao período.
+    uint32_t margin;
+
+    /// Tempo reservado antes de cada slot para acordar do modo de baixo
+    /// consumo e preparar a mensagem, ou zero caso o modo esteja desligado.
+    uint32_t wakeup;
+
+    /// Atraso do fim da operação LoRa, em partes por mil do ToA.
+    uint16_t excessPermille;
+};
+
+/// Cabeçalho da sincronização, enviado pelo transmissor antes da descrição
+/// do cronograma e do pacote de sincronização, para que ambos os aparelhos
+/// usem os mesmos parâmetros. O cronograma é identificado pelo seu hash.
+struct sync_header_t {
+    uint32_t hash;
+    uint32_t test;
+    slot_timing_t timing;
+};
+
+static_assert(sizeof(schedule_spec_t) <= RADIOLIB_SX126X_MAX_PACKET_LENGTH,
+              "A descrição do cronograma não cabe em um único pacote");
+
+/// O modelo de timing atual. O receptor o substitui pelo modelo recebido do
+/// transmissor na sincronização. O atraso do transmissor é calculado em
+/// `setup` por `syncTxDelay`.
+slot_timing_t _slotTiming = {
+    .txDelay = 0,
+    .processing = PROCESSING_BUDGET,
+    .margin = SLOT_MARGIN,
+    .wakeup = WAKEUP_BUDGET,
+    .excessPermille = LORA_EXCESS_PERMILLE,
+};
+
+/// Resumo de um teste, enviado por cada receptor ao transmissor no slot de
+/// uplink correspondente ao seu identificador.
+struct node_summary_t {
+    uint32_t test;
+    float rssi;
+    float snr;
+    float goodput;
+    float rssiStddev;
+    float snrStddev;
+    uint16_t ok;
+    uint16_t corrupt;
+    uint16_t lost;
+    uint8_t node;
+};
+
+/// Pacote trocado nos slots de feedback do modo adaptativo: a decisão do
+/// receptor de encerrar o teste, e a confirmação do transmissor.
+struct feedback_t {
+    uint32_t test;
+    uint16_t messages;
+    uint8_t stop;
+
+    /// `true` caso o PER não possa mais convergir até o fim do teste,
+    /// encerrando os slots de feedback do teste.
+    uint8_t done;
+};
+
+/// O resultado de cada mensagem é armazenado no mesmo formato gravado no
+/// log binário.
+using msg_result_t = log_message_record_t;
+
+/// Uma entrada da fila de resultados: os parâmetros de um novo teste, o
+/// resultado de uma mensagem ou o resumo de um receptor, identificados pelo
+/// primeiro byte.
+union result_entry_t {
+    uint8_t type;
+    log_test_record_t test;
+    msg_result_t message;
+    log_summary_record_t summary;
+};
+
+/// Cópia do estado do experimento exibido na interface. Publicada pela task
+/// do timer ao fim de cada slot, para que a task da interface nunca leia o
+/// estado enquanto ele é modificado.
+struct ui_snapshot_t {
+    radio_parameters_t parameters;
+    uint32_t test;
+    uint8_t payloadLength;
+
+    /// O ToA da mensagem nos parâmetros atuais, em microsegundos.
+    uint64_t toa;
+
+    uint32_t ok;
+    uint32_t corrupt;
+    uint32_t lost;
+    int16_t rssi;
+    float snr;
+
+    /// Estatísticas do RSSI e SNR do teste atual.
+    running_stats_t rssiStats;
+    running_stats_t snrStats;
+
+    /// Tempos do último slot, usados na barra de progresso.
+    int64_t operationBegin;
+    int64_t operationEnd;
+    int64_t timedEnd;
+    uint64_t period;
+
+    const char* resultMessage;
+    bool timerLatch;
+    bool logLatch;
+};
+
+/// Valor de `loopback_result_t::index` enviado pela task do receptor quando
+/// os parâmetros de um teste foram aplicados.
+#define LOOPBACK_READY 0xffff
+
+/// Comando enviado à task do receptor do modo de loopback no início de cada
+/// teste.
+struct loopback_command_t {
+    radio_parameters_t parameters;
+    uint16_t messages;
+
+    /// O timeout da recepção de cada mensagem, em microsegundos.
+    uint64_t timeout;
+};
+
+/// O resultado de cada recepção do modo de loopback, enviado pela task do
+/// receptor.
+struct loopback_result_t {
+    /// O índice da mensagem no teste, ou `LOOPBACK_READY`.
+    uint16_t index;
+    radio_error_t error;
+
+    int16_t rssi;
+    float snr;
+
+    /// O instante do interrupt do fim da recepção.
+    int64_t end;
+};
 
 void setup() {
     Serial.begin(115200);
@@ -70,50 +428,115 @@ void setup() {
     halInit();
     radioInit();
     timerInit();
-    uiSetup();
+
+    _slotTiming.txDelay = syncTxDelay();
+    _controlToa.syncHeader =
+        radioTransmitTime(_syncParameters, sizeof(sync_header_t));
+    _controlToa.syncSpec =
+        radioTransmitTime(_specParameters, sizeof(schedule_spec_t));
+    _controlToa.syncMark = radioTransmitTime(_markParameters, 1);
+    _toa = radioTransmitTime(_parameters, _payloadLength);
+
+    // Carregar o identificador do aparelho
+    _preferences.begin("lora-test", false);
+    _nodeId = _preferences.getUChar("node", 0);
+
+#ifdef HEADLESS
+    // Iniciar sem o OLED caso o cargo esteja configurado
+    loadRole();
+    if (_role == kUnspecified)
+#endif
+    {
+        uiSetup();
+        _uiEnabled = true;
+    }
 
     logPrintf("Modulo iniciado\n");
 }
 
+#ifdef HEADLESS
+/// Carrega o cargo do modo sem interface de `ROLE_FILENAME`, gravando-o na
+/// memória não volátil, ou do cargo gravado no último boot.
+void loadRole() {
+    // O modo de loopback não usa o cargo, e o cartão SD não pode ser usado
+#if !defined(FIXED_ROLE) && !defined(LOOPBACK)
+    _hasSD = logInit(LOG_FILENAME);
+
+    char roleText[8];
+    if (_hasSD && logReadFile(ROLE_FILENAME, roleText, sizeof(roleText))) {
+        if (strncmp(roleText, "tx", 2) == 0)
+            _preferences.putUChar("role", kTx);
+        else if (strncmp(roleText, "rx", 2) == 0)
+            _preferences.putUChar("role", kRx);
+        else
+            _preferences.remove("role");
+    }
+
+    const uint8_t role = _preferences.getUChar("role", kUnspecified);
+    if (role == kTx || role == kRx)
+        _role = (role_t)role;
+#endif
+}
+#endif
+
+/// Retorna o atraso do transmissor: o delay máximo da recepção do pacote de
+/// sincronização, proporcional ao seu ToA, mais `SYNC_GUARD`.
+uint32_t syncTxDelay() {
+    const uint64_t toa = radioTransmitTime(_markParameters, 1);
+    return SYNC_GUARD + (toa * LORA_EXCESS_PERMILLE) / 1000;
+}
+
+/// Retorna o período, em microsegundos, de um slot cuja operação LoRa tem o
+/// ToA dado. Inclui a espera do receptor pelo transmissor, o atraso variável
+/// do fim da operação, o processamento, a margem de segurança e o tempo para
+/// acordar do modo de baixo consumo.
+uint64_t slotPeriod(uint64_t toa) {
+    return _slotTiming.txDelay + toa +
+           (toa * _slotTiming.excessPermille) / 1000 + _slotTiming.processing +
+           _slotTiming.margin + _slotTiming.wakeup;
+}
+
+/// Gera a tabela de combinações do experimento a partir de `_scheduleSpec`,
+/// voltando ao cronograma padrão caso a descrição não gere nenhuma combinação.
+void buildSchedule() {
+    radio_parameters_t base = _syncParameters;
+    base.syncWord = 0xEA;
+    base.boostedRxGain = false;
+
+    if (scheduleBuild(_scheduleSpec, base) > 0)
+        return;
+
+    Serial.println("Cronograma vazio, usando o padrão");
+    _scheduleSpec = scheduleDefault(_messageLength);
+    scheduleBuild(_scheduleSpec, base);
+}
+
 /// Atualiza os parâmetros atuais do teste de acordo com o índice do teste
 /// atual. Retorna `true` se o índice do teste era inválido.
 bool updateTestParameters() {
-    const uint8_t power[] = { 5, 10, 17, 22 };
-    const uint8_t sf[] = { 7, 8, 9, 10, 11, 12 };
-    const uint8_t cr[] = { 5, 8 };
-    const float bw[] = { 62.5, 125.0, 250.0 };
-
-    // Tamanho dos vetores dos parâmetros
-    const size_t powerSize = sizeof(power) / sizeof(uint8_t);
-    const size_t sfSize = sizeof(sf) / sizeof(uint8_t);
-    const size_t crSize = sizeof(cr) / sizeof(uint8_t);
-    const size_t bwSize = sizeof(bw) / sizeof(float);
-
     bool wasInvalidTest = _currentTest == 0;
 
     // Limita o índice do teste para índices válidos
-    _currentTest %= bwSize * crSize * sfSize * powerSize;
+    _currentTest %= _scheduleLength;
 
     // Caso o índice do teste esteja acima do limite, será `true`
     wasInvalidTest = !wasInvalidTest && _currentTest == 0;
 
-    uint32_t index = _currentTest;
-
-    _parameters.bandwidth = bw[index % bwSize];
-    index /= bwSize;
-
-    _parameters.cr = cr[index % crSize];
-    index /= crSize;
+    // Os parâmetros e o ToA já foram calculados por `scheduleBuild`
+    const schedule_entry_t& entry = _schedule[_currentTest];
+    _parameters = entry.parameters;
+    _payloadLength = entry.payloadLength;
+    _toa = entry.toa;
 
-    _parameters.sf = sf[index % sfSize];
-    index /= sfSize;
+    // Os slots de feedback e de uplink usam os parâmetros do teste
+    const radio_parameters_t uplink = uplinkParameters();
+    _controlToa.feedback = radioTransmitTime(uplink, sizeof(feedback_t));
+    _controlToa.summary = radioTransmitTime(uplink, sizeof(node_summary_t));
 
-    _parameters.power = power[index % powerSize];
-    index /= powerSize;
+    // Gerar o pacote do teste antes do seu início
+    packetBuildFrame(_payloadLength);
 
     // Atualizar parâmetros no radiotransmissor
-    _parameters.syncWord = 0xEA;
-    _parameters.boostedRxGain = false;
     radioSetParameters(_parameters);
     return wasInvalidTest;
 }
@@ -151,8 +574,10 @@ int printMinimalPeriod(char* buffer, size_t size, uint64_t start,
     return snprintf(buffer, size, "%.1f/%.1f %s", fStart, fEnd, unit);
 }
 
-/// Desenha o overlay com os parâmetros e resultados da transmissão atual.
-void drawTestOverlay(const char* title, bool drawQuality, bool drawToA) {
+/// Desenha o overlay com os parâmetros e resultados do estado dado.
+void drawTestOverlay(const char* title, bool drawQuality, bool drawToA,
+                     const ui_snapshot_t& state) {
+    const radio_parameters_t& param = state.parameters;
     char buffer[1024];
 
     // Desenhar textos estáticos
@@ -164,7 +589,7 @@ void drawTestOverlay(const char* title, bool drawQuality, bool drawToA) {
 
     // Desenhar título fallback caso nenhum titulo tenha sido passado
     if (title == NULL) {
-        snprintf(buffer, 1024, "Teste %u", _currentTest);
+        snprintf(buffer, 1024, "Teste %u", state.test);
         uiText(0, 0, buffer);
     } else {
         uiText(0, 0, title);
@@ -177,48 +602,57 @@ void drawTestOverlay(const char* title, bool drawQuality, bool drawToA) {
     uiText(128 - 55, paramsY + 10, "SNR");
 
     // Escrever valor do spreading factor atual
-    snprintf(buffer, 1024, "SF%d", _parameters.sf);
+    snprintf(buffer, 1024, "SF%d", param.sf);
     uiText(128 - 55, paramsY, buffer);
 
     if (drawToA) {
         // Desenhar tempo de transmissão alinhado com a largura de banda
-        const uint64_t toa = radioTransmitTime(_parameters, _messageLength);
         uiText(0, paramsY - 10, "ToA");
 
         uiAlign(kRight);
-        printMinimalTime(buffer, 1024, toa);
+        printMinimalTime(buffer, 1024, state.toa);
         uiText(60, paramsY - 10, buffer);
     } else {
         // Printar quantia de pacotes ok, corruptos e perdidos
         uiAlign(kCenter);
-        snprintf(buffer, 1024, "(%u/%u/%u)", _testsOk, _testsCorrupt,
-                 _testsLost);
+        snprintf(buffer, 1024, "(%u/%u/%u)", state.ok, state.corrupt,
+                 state.lost);
         uiText(0, paramsY - 10, buffer);
     }
 
     // Escrever valor do coding rate atual
     uiAlign(kRight);
-    snprintf(buffer, 1024, "CR%d", _parameters.cr);
+    snprintf(buffer, 1024, "CR%d", param.cr);
     uiText(0, paramsY, buffer);
 
     // Escrever valor da potência
-    snprintf(buffer, 1024, "(%d dBm)", _parameters.power);
+    snprintf(buffer, 1024, "(%d dBm)", param.power);
     uiText(0, 0, buffer);
 
     // Escrever valor da largura de banda atual
-    if ((_parameters.bandwidth - (int)_parameters.bandwidth) == 0)
-        snprintf(buffer, 1024, "%.0fkHz", _parameters.bandwidth);
+    if ((param.bandwidth - (int)param.bandwidth) == 0)
+        snprintf(buffer, 1024, "%.0fkHz", param.bandwidth);
     else
-        snprintf(buffer, 1024, "%.1fkHz", _parameters.bandwidth);
+        snprintf(buffer, 1024, "%.1fkHz", param.bandwidth);
 
     uiText(60, paramsY, buffer);
 
-    // Escrever RSSI atual
-    snprintf(buffer, 1024, "%hddBm", radioRSSI());
+    // Escrever a média e desvio padrão do RSSI e SNR do teste, ou os valores
+    // atuais caso nenhuma mensagem tenha sido recebida
+    if (state.rssiStats.count > 0) {
+        snprintf(buffer, 1024, "%.0f±%.0f", state.rssiStats.mean,
+                 statsStddev(state.rssiStats));
+    } else {
+        snprintf(buffer, 1024, "%hddBm", state.rssi);
+    }
     uiText(60, paramsY + 10, buffer);
 
-    // Escrever SNR atual
-    snprintf(buffer, 1024, "%.0fdB", radioSNR());
+    if (state.snrStats.count > 0) {
+        snprintf(buffer, 1024, "%.0f±%.0f", state.snrStats.mean,
+                 statsStddev(state.snrStats));
+    } else {
+        snprintf(buffer, 1024, "%.0fdB", state.snr);
+    }
     uiText(0, paramsY + 10, buffer);
 }
 
@@ -228,16 +662,143 @@ enum protocol_state_t {
     kRunning,
     kFinished,
     kPing,
+    kLoopback,
 };
 
+/// O modo de loopback não usa o menu nem a sincronização.
+#ifdef LOOPBACK
+protocol_state_t _protoState = kLoopback;
+#else
 protocol_state_t _protoState = kUninitialized;
+#endif
 uint32_t _messageIndex = 0;
 uint64_t _begin = 0;
 
+/// Envia a sincronização do transmissor: o cabeçalho com o teste dado, nos
+/// parâmetros de `_syncParameters`, a descrição do cronograma nos parâmetros
+/// de `_specParameters` e por fim um pacote curto nos parâmetros de
+/// `_markParameters`, cujo fim determina o início do relógio dos receptores.
+/// Manter o pacote de sincronização curto reduz o erro da sincronização.
+/// Caso `markTime` seja positivo, o pacote de sincronização é enviado neste
+/// instante, e não `SYNC_GAP` após a descrição.
+radio_error_t sendSync(uint32_t test, int64_t markTime) {
+    sync_header_t header = {
+        .hash = scheduleHash(_scheduleSpec),
+        .test = test,
+        .timing = _slotTiming,
+    };
+    uint8_t mark = 0;
+
+    radioSetParameters(_syncParameters);
+    radio_error_t error = radioSend((uint8_t*)&header, sizeof(header));
+
+    if (error == kNone) {
+        delay(SYNC_GAP);
+        radioSetParameters(_specParameters);
+        error = radioSend((uint8_t*)&_scheduleSpec, sizeof(_scheduleSpec));
+        radioSetParameters(_markParameters);
+    }
+
+    if (error == kNone) {
+        const int64_t wait =
+            markTime > 0 ? markTime - timerTime() : SYNC_GAP * 1000;
+
+        if (wait > 0)
+            delay((wait + 999) / 1000);
+
+        error = radioSend(&mark, sizeof(mark));
+    }
+
+    return error;
+}
+
+/// Recebe a sincronização enviada por `sendSync`, bloqueando até o seu fim.
+/// A descrição do cronograma só é recebida caso o hash do cabeçalho seja
+/// diferente do de `*spec`, de forma que um receptor que já conhece o
+/// cronograma não depende dos parâmetros mais rápidos da descrição.
+radio_error_t recvSync(sync_header_t* header, schedule_spec_t* spec) {
+    uint8_t length = sizeof(*header);
+    radioSetParameters(_syncParameters);
+    radio_error_t error = radioRecv((uint8_t*)header, &length);
+
+    if (error == kNone && length != sizeof(*header))
+        error = kUnknown;
+
+    if (error == kNone && header->hash != scheduleHash(*spec)) {
+        length = sizeof(*spec);
+        radioSetParameters(_specParameters);
+        error = radioRecv((uint8_t*)spec, &length,
+                          SYNC_GAP * 2000 + _controlToa.syncSpec);
+
+        if (error == kNone && (length != sizeof(*spec) ||
+                               scheduleHash(*spec) != header->hash))
+            error = kUnknown;
+    }
+
+    // O pacote de sincronização chega após a descrição, mesmo que ela não
+    // tenha sido recebida
+    if (error == kNone) {
+        uint8_t mark = 0;
+        length = sizeof(mark);
+        radioSetParameters(_markParameters);
+        error = radioRecv(&mark, &length, syncMarkTimeout());
+    }
+
+    return error;
+}
+
+/// Retorna o timeout, a partir do fim do cabeçalho, da recepção do pacote de
+/// sincronização.
+uint64_t syncMarkTimeout() {
+    return SYNC_GAP * 4000 + 2 * _slotTiming.processing +
+           _controlToa.syncSpec + _controlToa.syncMark;
+}
+
 /// Executa após um cargo ser selecionado no menu.
 void syncLoop() {
+    if (_bootSyncStart < 0)
+        _bootSyncStart = timerTime();
+
     // Tentar inicializar o logger no cartão SD
-    _hasSD = logInit("/log.txt");
+    _hasSD = logInit(LOG_FILENAME);
+    logSetConsumer(writeResults);
+
+    // Carregar o cronograma definido pelo usuário, caso exista
+    static char scheduleText[1024];
+    if (_role == kTx && _hasSD &&
+        logReadFile(SCHEDULE_FILENAME, scheduleText, sizeof(scheduleText))) {
+        schedule_spec_t spec = scheduleDefault(_messageLength);
+
+        if (scheduleParse(scheduleText, &spec))
+            _scheduleSpec = spec;
+        else
+            Serial.println("Erro ao ler " SCHEDULE_FILENAME ", usando o "
+                           "cronograma padrão");
+    }
+
+    // Retomar o cronograma interrompido por uma reinicialização, caso o
+    // cronograma não tenha mudado. O receptor recebe o teste na configuração
+    _sweepId = scheduleHash(_scheduleSpec);
+    if (_role == kTx && _preferences.getUInt("sweep", 0) == _sweepId) {
+        _currentTest = _preferences.getUInt("test", 0);
+
+        if (_currentTest > 0)
+            Serial.printf("Retomando o teste %u\n", _currentTest);
+    }
+
+    // Usar o último cronograma recebido, que o transmissor não precisa
+    // enviar novamente caso não tenha mudado
+    if (_role == kRx &&
+        _preferences.getBytesLength("spec") == sizeof(_scheduleSpec))
+        _preferences.getBytes("spec", &_scheduleSpec, sizeof(_scheduleSpec));
+
+    // Atualizar o identificador do receptor, caso definido no cartão SD
+    char nodeText[8];
+    if (_role == kRx && _hasSD &&
+        logReadFile(NODE_FILENAME, nodeText, sizeof(nodeText))) {
+        _nodeId = atoi(nodeText);
+        _preferences.putUChar("node", _nodeId);
+    }
 
     uiLoop();
 
@@ -245,22 +806,24 @@ void syncLoop() {
     radioSetParameters(_parameters);
 
     // Desenhar interface antes da operação LoRa
-    uiClear();
-    drawTestOverlay(NULL, _role == kRx, true);
+    if (_uiEnabled) {
+        uiClear();
+        drawTestOverlay(NULL, _role == kRx, true, takeSnapshot());
 
-    uiAlign(kCenter);
-    uiText(0, 15, _role == kRx ? "Esperando sync..." : "Enviando sync...");
-    uiFinish();
+        uiAlign(kCenter);
+        uiText(0, 15,
+               _role == kRx ? "Esperando sync..." : "Enviando sync...");
+        uiFinish();
+    }
 
     radio_error_t error = kNone;
-    uint8_t message[] = { _currentTest };
-    uint8_t length = sizeof(message) / sizeof(uint8_t);
+    sync_header_t header = {};
+    schedule_spec_t spec = _scheduleSpec;
 
-    if (_role == kRx) {
-        error = radioRecv(message, &length);
-    } else if (_role == kTx) {
-        error = radioSend(message, length);
-    }
+    if (_role == kRx)
+        error = recvSync(&header, &spec);
+    else if (_role == kTx)
+        error = sendSync(_currentTest, 0);
 
     // Tentar novamente caso a transmissão tenha falhado.
     if (error != kNone) {
@@ -270,21 +833,55 @@ void syncLoop() {
         return;
     }
 
-    // Atualizar parâmetros do teste e iniciar o experimento.
-    _currentTest = message[0];
-    updateTestParameters();
+    // O relógio dos dois aparelhos começa no interrupt do fim do pacote de
+    // sincronização, e não após o processamento seguinte, cuja duração
+    // varia entre os aparelhos
+    const int64_t markEnd = radioIRQTime();
+    const bool specChanged = scheduleHash(spec) != scheduleHash(_scheduleSpec);
+
+    // Atualizar parâmetros do teste e iniciar o experimento
+    if (_role == kRx) {
+        _scheduleSpec = spec;
+        _currentTest = header.test;
+        _slotTiming = header.timing;
+    }
 
-    const auto totalBudget =
-        radioTransmitTime(_parameters, _messageLength) + BUDGET;
+    buildSchedule();
+    updateTestParameters();
+    beginTestResults();
 
-    // Esperar `TX_DELAY` microsegundos do budget do transmissor
+    // Esperar `txDelay` microsegundos do slot do transmissor
     // para garantir que os receptores começam a receber antes do
     // transmissor começar a enviar.
-    timerStart(totalBudget + (_role == kTx ? TX_DELAY : 0), timedLoop);
-    timerResync(totalBudget, timedLoop);
+    const uint64_t period = slotPeriod(_toa);
+    const int64_t firstSlot =
+        markEnd + period + (_role == kTx ? _slotTiming.txDelay : 0);
+    const int64_t first = firstSlot - timerTime();
+
+    timerStart(first > 0 ? first : 1, timedLoop);
+    timerResync(period, timedLoop);
+
+    // O receptor guarda o cronograma para não precisar recebê-lo após
+    // reiniciar. A escrita na memória flash é feita após iniciar o timer
+    if (_role == kRx && specChanged)
+        _preferences.putBytes("spec", &_scheduleSpec, sizeof(_scheduleSpec));
 
     _begin = timerTime();
     _protoState = kRunning;
+
+    // O relógio do ESP32 começa ao iniciar o firmware, sem incluir o
+    // bootloader. No receptor, o tempo inclui a espera pelo transmissor
+    Serial.printf("Boot: sync em %lld ms, primeiro slot em %lld ms\n",
+                  (long long)(_bootSyncStart / 1000),
+                  (long long)(firstSlot / 1000));
+
+    // Desenhar a interface no outro núcleo durante o experimento. No modo de
+    // baixo consumo, a tela mantém o último quadro desenhado
+    publishSnapshot();
+#ifndef LOW_POWER
+    if (_uiEnabled)
+        uiTaskStart(drawRunningFrame, UI_FRAME_RATE);
+#endif
 }
 
 const char* _resultMessage = "(...)";
@@ -300,21 +897,31 @@ int64_t _timedEnd = 0;
 /// tempo.
 bool _timerLatch = false;
 
-struct msg_result_t {
-    int64_t startTime;
-    int64_t loraEndTime;
-    int64_t endTime;
-    int64_t period;
-    int64_t nextAlarm;
-    uint8_t message[_messageLength];
-    uint8_t length;
-    int16_t rssi;
-    float snr;
-    radio_error_t error;
-};
+/// Maiores tempos medidos no teste atual para a operação LoRa (a partir do
+/// início do slot) e para o processamento após ela, comparados ao modelo de
+/// `slotPeriod` no fim de cada teste.
+int64_t _slotMaxLora = 0;
+int64_t _slotMaxProcessing = 0;
+
+/// Quantidade de entradas na fila de resultados. Limita apenas quantos
+/// resultados podem aguardar a task do datalogger, e não a quantidade de
+/// mensagens por teste.
+#define RESULT_QUEUE_LENGTH 128
+
+/// Fila de resultados, produzida por `timedLoop` e consumida pela task do
+/// datalogger.
+spsc_queue_t<result_entry_t, RESULT_QUEUE_LENGTH> _resultQueue;
+
+/// O resultado da mensagem atual.
+msg_result_t _result;
+
+/// Parâmetros do último teste lido da fila pelo datalogger, usados para
+/// imprimir cada linha do CSV.
+log_test_record_t _logTest;
 
-/// Armazena o resultado de cada mensagem em um teste.
-msg_result_t _results[MESSAGES_PER_TEST];
+/// Setada com "true" quando a fila de resultados estiver cheia e um
+/// resultado for descartado.
+bool _logLatch = false;
 
 /// Executa o experimento principal para o receptor e transmissor.
 ///
@@ -325,34 +932,48 @@ void timedLoop() {
     _nextAlarm = timerNextTick();
     _currentPeriod = timerPeriod();
 
-    const uint64_t toa = radioTransmitTime(_parameters, _messageLength);
-    const uint64_t totalBudget = toa + BUDGET;
+    const uint64_t toa = _toa;
 
     radio_error_t error = kNone;
 
     _operationBegin = timerTime();
 
-    // Armazenar dados iniciais da mensagem atual
-    msg_result_t& result = _results[_messageIndex];
-    result.length = _messageLength;
+    msg_result_t& result = _result;
+    result = {};
+    result.type = kLogRecordMessage;
+    result.index = _messageIndex;
+
+    // O transmissor registra o comprimento enviado, e o receptor o recebido,
+    // escrito por `radioWait` e limitado ao tamanho do buffer
+    result.length = _role == kTx ? packetLength() : sizeof(_packetRx);
+    result.frequency = messageFrequency();
+
+    // A operação é normalmente preparada no fim do slot anterior, exceto na
+    // primeira mensagem de cada teste.
+    if (!radioArmed())
+        error = armNextMessage();
+
+    // Enviar o atraso do início da transmissão para a correção do desvio dos
+    // relógios no receptor
+    if (error == kNone && _role == kTx) {
+        const uint32_t txLatency = timerTime() - (_nextAlarm - _currentPeriod);
+        error = radioPatchArmed(PACKET_LATENCY_OFFSET, &txLatency,
+                                sizeof(txLatency));
+    }
+
+    // Iniciar a operação LoRa o quanto antes, sem aguardar seu fim.
+    if (error == kNone)
+        error = radioFire();
+
+    // Armazenar dados iniciais da mensagem atual enquanto o pacote está no ar
     result.startTime = _operationBegin;
     result.nextAlarm = _nextAlarm;
     result.period = _currentPeriod;
-    _message[0] = _messageIndex;
+    result.timerLatency = timerLatency();
 
-    if (_role == kRx) {
-        // Usamos o ToA do pacote completo como o timeout para a recepção.
-        // Note que o timeout do receptor é interrompido após o receptor
-        // detectar o header completo de um pacote, logo, caso um pacote seja
-        // detectado no final deste timeout, o processo de recepção de um pacote
-        // pode ultrapassar o budget de tempo máximo pra função `timedLoop`.
-        error = radioRecv(
-            result.message, &result.length,
-            radioTransmitTime(_parameters, _messageLength) + TX_DELAY);
-    } else if (_role == kTx) {
-        // Enviar mensagem e imprimir status da transmissão no Serial
-        error = radioSend(_message, _messageLength);
-    }
+    // Dormir até o fim da operação, caso ela tenha sido iniciada
+    if (error == kNone)
+        error = radioWait();
 
     _operationEnd = timerTime();
     result.loraEndTime = _operationEnd;
@@ -361,123 +982,741 @@ void timedLoop() {
     result.error = error;
     result.rssi = radioRSSI();
     result.snr = radioSNR();
+    result.irqLatency = error == kUnknown ? 0 : radioIRQLatency();
+    result.energy =
+        error == kUnknown
+            ? 0
+            : energyOperation(_role == kTx, _parameters.power,
+                              _parameters.boostedRxGain,
+                              result.loraEndTime - result.startTime);
+    _testStats.energy += result.energy;
+
+    if (_role == kRx && error == kNone) {
+        result.payloadErrors =
+            packetValidate(_packetRx, result.length, result.index);
+        correctDrift(result, _packetRx, toa);
+    }
 
     // Atualizar mensagem no display com erro apropriado
     switch (error) {
     case kNone:
         _resultMessage = "(ok)";
         _testsOk++;
+        _testStats.ok++;
+        statsAdd(&_testStats.rssi, result.rssi);
+        statsAdd(&_testStats.snr, result.snr);
+        statsHistogramAdd(_testStats.rssiHistogram, result.rssi,
+                          STATS_RSSI_START, STATS_RSSI_WIDTH);
+        statsHistogramAdd(_testStats.snrHistogram, result.snr,
+                          STATS_SNR_START, STATS_SNR_WIDTH);
         break;
     case kTimeout:
         _resultMessage = "(t.out)";
         _testsLost++;
+        _testStats.lost++;
         break;
     case kHeader:
     case kCrc:
         _resultMessage = "(crc/h)";
         _testsCorrupt++;
+        _testStats.corrupt++;
         break;
     case kUnknown:
         _resultMessage = "(err)";
         _testsLost++;
+        _testStats.lost++;
         break;
     }
 
     _messageIndex++;
 
-    // Iniciar período de escrita do cartão SD após a mensagem final do
-    // parâmetro atual.
-    if (_messageIndex == MESSAGES_PER_TEST) {
-        timerResync(SD_BUDGET, sdLoop);
-    }
+    // Após a mensagem final do parâmetro atual, coletar os resumos dos
+    // receptores, caso existam, e reconfigurar o radio.
+    const bool feedback = _messageIndex < MESSAGES_PER_TEST && feedbackDue();
+
+    if (_messageIndex == MESSAGES_PER_TEST)
+        endTestMessages();
+    else if (feedback)
+        timerResync(feedbackPeriod(), verdictLoop);
 
     _timedEnd = timerTime();
-    _timerLatch |= (_timedEnd - _operationBegin) > _currentPeriod;
+    _timerLatch |= (uint64_t)(_timedEnd - _operationBegin) > _currentPeriod;
     result.endTime = _timedEnd;
 
-    // Imprimir informações de timing para debugging
-    logDebugPrintf(
-        "%lld,%lld,%lld / lora_excess: %lld, budget_used: %lld, toa: %llu, "
-        "period: %llu, alarm: %lld\n",
-        _operationBegin, _operationEnd, _timedEnd,
-        (_operationEnd - _operationBegin) - toa, (_timedEnd - _operationEnd),
-        toa, _currentPeriod, _nextAlarm);
+    // Medir o uso real do slot. Os histogramas são impressos pela task do
+    // datalogger no fim de cada teste.
+    probeRecord(kProbeLoraExcess,
+                (result.loraEndTime - result.startTime) - (int64_t)toa);
+    probeRecord(kProbeProcessing, result.endTime - result.loraEndTime);
+
+    if (result.loraEndTime - result.startTime > _slotMaxLora)
+        _slotMaxLora = result.loraEndTime - result.startTime;
+
+    if (result.endTime - result.loraEndTime > _slotMaxProcessing)
+        _slotMaxProcessing = result.endTime - result.loraEndTime;
+
+    // Enviar o resultado para a task do datalogger
+    result_entry_t entry;
+    entry.message = result;
+    pushResult(entry);
+    publishSnapshot();
+
+    // Preparar a próxima mensagem, caso ela use os mesmos parâmetros. Os
+    // slots de feedback usam outros parâmetros, logo a mensagem é preparada
+    // no início do slot seguinte a eles.
+    if (_messageIndex < MESSAGES_PER_TEST && !feedback) {
+#ifdef LOW_POWER
+        sleepUntilNextSlot();
+#endif
+        armNextMessage();
+    }
+}
+
+/// Dorme até `wakeup` microsegundos antes do próximo slot, no modo de baixo
+/// consumo. O radiotransmissor acorda ao preparar a próxima mensagem.
+void sleepUntilNextSlot() {
+    radioSleep();
+
+    // Não pausar a task do datalogger durante uma escrita no cartão SD, e
+    // impedir que ela comece uma escrita antes do sleep
+    if (logTryLock()) {
+        timerLightSleep(_slotTiming.wakeup);
+        logUnlock();
+    }
+}
+
+/// Retorna a frequência, em MHz, da mensagem `_messageIndex`. A sequência de
+/// saltos continua de um teste para o seguinte, para que todos os canais
+/// sejam visitados mesmo com mais canais do que mensagens em um teste.
+float messageFrequency() {
+    const uint32_t sequence = _currentTest * MESSAGES_PER_TEST + _messageIndex;
+    return scheduleHopFrequency(_scheduleSpec, _parameters.frequency,
+                                sequence);
+}
+
+/// Prepara a operação LoRa da mensagem `_messageIndex` no radiotransmissor,
+/// para que ela seja iniciada com um único comando no início do slot.
+radio_error_t armNextMessage() {
+    // Saltar para o canal da mensagem, mantendo a calibração do teste
+    const radio_error_t error = radioHop(messageFrequency());
+
+    if (error != kNone)
+        return error;
+
+    if (_role == kRx) {
+        // Usamos o ToA do pacote completo como o timeout para a recepção.
+        // Note que o timeout do receptor é interrompido após o receptor
+        // detectar o header completo de um pacote, logo, caso um pacote seja
+        // detectado no final deste timeout, o processo de recepção de um pacote
+        // pode ultrapassar o budget de tempo máximo pra função `timedLoop`.
+        return radioArmRecv(_packetRx, &_result.length,
+                            _toa + _slotTiming.txDelay);
+    }
+
+    return radioArmSend(packetFrame(_messageIndex), packetLength());
+}
+
+/// Agenda os slots seguintes à última mensagem do teste atual: os slots de
+/// uplink, caso existam, e a reconfiguração do radio.
+void endTestMessages() {
+    if (_scheduleSpec.nodes > 0)
+        timerResync(uplinkPeriod(), uplinkLoop);
+    else
+        timerResync(RECONFIG_BUDGET, nextTestLoop);
+}
+
+/// A decisão atual de encerrar o teste no modo adaptativo, e de não
+/// executar mais slots de feedback no teste atual.
+bool _feedbackStop = false;
+bool _feedbackDone = false;
+
+/// Com `n` mensagens, a menor largura possível do intervalo de Wilson, com
+/// PER igual a 0, é z² / (n + z²). Antes desta quantidade de mensagens,
+/// nenhum teste pode convergir.
+#define ADAPTIVE_MIN_MESSAGES \
+    (ADAPTIVE_Z * ADAPTIVE_Z * (1 / ADAPTIVE_MAX_WIDTH - 1))
+
+/// Retorna a largura do intervalo de confiança de Wilson de 95% de um PER
+/// medido em `n` mensagens.
+float perWidth(float per, float n) {
+    const float z2 = ADAPTIVE_Z * ADAPTIVE_Z;
+    const float half = ADAPTIVE_Z *
+                       sqrtf(per * (1 - per) / n + z2 / (4 * n * n)) /
+                       (1 + z2 / n);
+
+    return 2 * half;
+}
+
+/// Retorna `true` caso o intervalo de confiança do PER do teste atual seja
+/// estreito o suficiente para encerrar o teste.
+bool perConverged(const test_stats_t& stats) {
+    const float n = stats.ok + stats.corrupt + stats.lost;
+    if (n == 0)
+        return false;
+
+    const float per = (stats.corrupt + stats.lost) / n;
+    return perWidth(per, n) <= ADAPTIVE_MAX_WIDTH;
+}
+
+/// Retorna `true` caso, mantido o PER atual, o intervalo não fique estreito
+/// o suficiente nem ao fim das `MESSAGES_PER_TEST` mensagens, como com PER
+/// próximo de 0.5. Os slots de feedback restantes seriam desperdiçados.
+bool perHopeless(const test_stats_t& stats) {
+    const float n = stats.ok + stats.corrupt + stats.lost;
+    if (n == 0)
+        return false;
+
+    const float per = (stats.corrupt + stats.lost) / n;
+    return perWidth(per, MESSAGES_PER_TEST) > ADAPTIVE_MAX_WIDTH;
+}
+
+/// Retorna o período, em microsegundos, de cada um dos dois slots de
+/// feedback. Como nos slots de uplink, o receptor aguarda `2 * txDelay`
+/// antes de enviar, e o radio é reconfigurado no início e no fim.
+uint64_t feedbackPeriod() {
+    return slotPeriod(_controlToa.feedback) + _slotTiming.txDelay +
+           RECONFIG_BUDGET;
+}
+
+/// Retorna `true` caso os slots de feedback devam ser executados após a
+/// mensagem atual. Os slots são pulados enquanto nenhum PER puder convergir,
+/// após o receptor indicar que o PER atual não converge, e quando o tempo
+/// restante do teste não compensa o seu custo, o que é decidido de forma
+/// igual nos dois aparelhos.
+bool feedbackDue() {
+    const uint8_t interval = _scheduleSpec.adaptive;
+
+    if (interval == 0 || _messageIndex % interval != 0 || _feedbackDone ||
+        _messageIndex < ADAPTIVE_MIN_MESSAGES)
+        return false;
+
+    const uint64_t remaining =
+        (uint64_t)(MESSAGES_PER_TEST - _messageIndex) * slotPeriod(_toa);
+    return remaining > 2 * feedbackPeriod();
 }
 
-/// Armazena os dados no vetor `_results` no cartão SD.
-void sdLoop() {
+/// Executa o primeiro slot de feedback, em que o receptor de identificador 0
+/// envia ao transmissor a decisão de encerrar ou não o teste atual.
+void verdictLoop() {
     _nextAlarm = timerNextTick();
     _currentPeriod = timerPeriod();
     _operationBegin = timerTime();
 
-    _resultMessage = "(escrevendo...)";
+    timerResync(feedbackPeriod(), echoLoop);
 
-    // Imprimir rótulo dos dados na primeira combinação
-    if (_currentTest == 0) {
-        if (_role == kRx) {
-            logPrintf(
-                "Start Time,Rx End Time,End Time,Period,Alarm,Parameter "
-                "Index,Message Index,Tx Power "
-                "(dBm),Spreading Factor,Coding Rate,Bandwidth (kHz),RSSI "
-                "(dBm),SNR (dB),Status,Message\n");
-        } else {
-            logPrintf(
-                "Start Time,Tx End Time,End Time,Period,Alarm,Parameter "
-                "Index,Message Index,Tx Power "
-                "(dBm),Spreading Factor,Coding Rate,Bandwidth (kHz),Status\n");
+    const uint64_t txDelay = _slotTiming.txDelay;
+    feedback_t feedback = {};
+    uint8_t length = sizeof(feedback);
+    radio_error_t error = kNone;
+
+    radioSetParameters(uplinkParameters());
+
+    if (_role == kRx) {
+        // Todos os receptores decidem, para o caso de não receberem a
+        // confirmação do transmissor
+        _feedbackStop = perConverged(_testStats);
+        _feedbackDone = !_feedbackStop && perHopeless(_testStats);
+
+        if (_nodeId == 0) {
+            feedback = {
+                .test = _currentTest,
+                .messages = (uint16_t)_messageIndex,
+                .stop = _feedbackStop,
+                .done = _feedbackDone,
+            };
+
+            // Aguardar o transmissor começar a receber
+            delay((2 * txDelay) / 1000);
+            error = radioSend((uint8_t*)&feedback, length);
         }
+    } else if (_role == kTx) {
+        error = radioRecv((uint8_t*)&feedback, &length,
+                          _controlToa.feedback + 2 * txDelay);
+
+        // Decisões perdidas ou atrasadas mantêm o teste e os slots
+        const bool valid = error == kNone && length == sizeof(feedback) &&
+                           feedback.test == _currentTest &&
+                           feedback.messages == _messageIndex;
+        _feedbackStop = valid && feedback.stop;
+        _feedbackDone = valid && feedback.done;
     }
 
-    for (size_t i = 0; i < MESSAGES_PER_TEST; i++) {
-        const msg_result_t& result = _results[i];
+    _operationEnd = _timedEnd = timerTime();
+    _timerLatch |= (uint64_t)(_timedEnd - _operationBegin) > _currentPeriod;
 
-        if (_role == kRx) {
-            // Imprimir todas as informações para resultados do receptor
-            logPrintf(
-                "%llu,%llu,%llu,%llu,%llu,%u,%u,%hhd,%hhu,%hhu,%f,%hi,%f,%u,",
-                result.startTime, result.loraEndTime, result.endTime,
-                result.period, result.nextAlarm, _currentTest, i,
-                _parameters.power, _parameters.sf, _parameters.cr,
-                _parameters.bandwidth, result.rssi, result.snr, result.error);
+    publishSnapshot();
+
+    logDebugPrintf("verdict: e%d, stop: %d, budget_used: %lld\n", error,
+                   _feedbackStop, (_timedEnd - _operationBegin));
+}
+
+/// Executa o segundo slot de feedback, em que o transmissor confirma a
+/// decisão recebida para todos os receptores, e ambos encerram o teste ou
+/// voltam às mensagens.
+void echoLoop() {
+    _nextAlarm = timerNextTick();
+    _currentPeriod = timerPeriod();
+    _operationBegin = timerTime();
+
+    feedback_t feedback = {
+        .test = _currentTest,
+        .messages = (uint16_t)_messageIndex,
+        .stop = _feedbackStop,
+        .done = _feedbackDone,
+    };
+    uint8_t length = sizeof(feedback);
+    radio_error_t error = kNone;
+
+    if (_role == kTx) {
+        // O transmissor está `txDelay` atrasado, logo os receptores já estão
+        // recebendo
+        error = radioSend((uint8_t*)&feedback, length);
+    } else if (_role == kRx) {
+        error = radioRecv((uint8_t*)&feedback, &length,
+                          _controlToa.feedback + _slotTiming.txDelay);
+
+        // Sem a confirmação, o receptor mantém a própria decisão, que é a
+        // mais provável de ter sido recebida pelo transmissor
+        if (error == kNone && length == sizeof(feedback) &&
+            feedback.test == _currentTest &&
+            feedback.messages == _messageIndex) {
+            _feedbackStop = feedback.stop;
+            _feedbackDone = feedback.done;
+        }
+    }
+
+    radioSetParameters(_parameters);
+
+    if (_feedbackStop) {
+        _resultMessage = "(conv.)";
+        endTestMessages();
+    } else {
+        timerResync(slotPeriod(_toa), timedLoop);
+    }
+
+    _operationEnd = _timedEnd = timerTime();
+    _timerLatch |= (uint64_t)(_timedEnd - _operationBegin) > _currentPeriod;
+
+    publishSnapshot();
+
+    logDebugPrintf("echo: e%d, stop: %d, budget_used: %lld\n", error,
+                   _feedbackStop, (_timedEnd - _operationBegin));
+}
+
+/// O slot de uplink atual, de 0 a `_scheduleSpec.nodes - 1`.
+uint8_t _uplinkSlot = 0;
+
+/// Retorna o período, em microsegundos, de um slot de uplink. Como o relógio
+/// do transmissor está `txDelay` atrasado em relação aos receptores, o
+/// receptor aguarda `2 * txDelay` antes de enviar o resumo, e o slot é
+/// estendido por mais um `txDelay`.
+uint64_t uplinkPeriod() {
+    return slotPeriod(_controlToa.summary) + _slotTiming.txDelay;
+}
+
+/// Retorna os parâmetros usados nos slots de uplink e de feedback: os do
+/// teste atual, mas sempre com o header explícito, já que o resumo e o
+/// feedback não possuem o comprimento das mensagens do teste. Assim, o custo
+/// dos slots acompanha o das mensagens, e testes curtos também podem ser
+/// encerrados cedo.
+radio_parameters_t uplinkParameters() {
+    radio_parameters_t parameters = _parameters;
+    parameters.packetLength = 0;
+    return parameters;
+}
+
+/// Executa um slot de uplink, em que o receptor com o identificador igual ao
+/// slot envia o resumo do teste atual ao transmissor.
+void uplinkLoop() {
+    _nextAlarm = timerNextTick();
+    _currentPeriod = timerPeriod();
+    _operationBegin = timerTime();
+
+    const uint8_t slot = _uplinkSlot++;
 
-            for (size_t i = 0; i < result.length; i++) {
-                logPrintf("%02x", result.message[i]);
+    // Voltar à frequência do teste após os saltos. Os parâmetros do teste
+    // são aplicados de novo por `nextTestLoop`
+    if (slot == 0)
+        radioSetParameters(uplinkParameters());
+
+    // Reconfigurar o radio após o último slot de uplink
+    if (_uplinkSlot == _scheduleSpec.nodes)
+        timerResync(RECONFIG_BUDGET, nextTestLoop);
+
+    const uint64_t txDelay = _slotTiming.txDelay;
+    node_summary_t summary = {};
+    uint8_t length = sizeof(summary);
+    radio_error_t error = kNone;
+
+    if (_role == kRx && slot == _nodeId) {
+        const log_summary_record_t local = testSummary();
+        summary = {
+            .test = local.test,
+            .rssi = local.rssi,
+            .snr = local.snr,
+            .goodput = local.goodput,
+            .rssiStddev = local.rssiStddev,
+            .snrStddev = local.snrStddev,
+            .ok = local.ok,
+            .corrupt = local.corrupt,
+            .lost = local.lost,
+            .node = _nodeId,
+        };
+
+        // Aguardar o transmissor começar a receber
+        delay((2 * txDelay) / 1000);
+        error = radioSend((uint8_t*)&summary, length);
+    } else if (_role == kTx) {
+        error = radioRecv((uint8_t*)&summary, &length,
+                          _controlToa.summary + 2 * txDelay);
+
+        if (error == kNone && length != sizeof(summary))
+            error = kUnknown;
+
+        // Descartar resumos atrasados ou de outro teste
+        if (error == kNone && summary.test == _currentTest) {
+            result_entry_t entry;
+            entry.summary = {
+                .type = kLogRecordSummary,
+                .node = summary.node,
+                .test = summary.test,
+                .ok = summary.ok,
+                .corrupt = summary.corrupt,
+                .lost = summary.lost,
+                .rssi = summary.rssi,
+                .snr = summary.snr,
+                .goodput = summary.goodput,
+                .energy = _testStats.energy,
+                .energyPerBit = energyPerBit(_testStats.energy, summary.ok,
+                                             _payloadLength),
+                .rssiStddev = summary.rssiStddev,
+                .snrStddev = summary.snrStddev,
+            };
+
+            pushResult(entry);
+        }
+    }
+
+    _operationEnd = _timedEnd = timerTime();
+    _timerLatch |= (uint64_t)(_timedEnd - _operationBegin) > _currentPeriod;
+
+    publishSnapshot();
+
+    logDebugPrintf("uplink %hhu: e%d, budget_used: %lld, period: %llu\n",
+                   slot, error, (_timedEnd - _operationBegin), _currentPeriod);
+}
+
+static struct {
+    /// O desvio medido na primeira mensagem recebida no teste atual, usado
+    /// como referência para as mensagens seguintes.
+    int64_t baseline;
+    bool hasBaseline;
+
+    /// Soma de todas as correções aplicadas ao relógio do receptor.
+    int64_t total;
+} _driftState;
+
+/// Estima o desvio entre o relógio do receptor e o do transmissor a partir
+/// do fim da recepção de uma mensagem, e ajusta o próximo slot do receptor
+/// para compensá-lo.
+///
+/// O desvio é o atraso entre o início do slot do receptor e o início da
+/// transmissão, descontando o atraso do transmissor enviado na mensagem.
+/// Como o atraso fixo da recepção não é conhecido, o desvio é comparado com
+/// o da primeira mensagem de cada teste.
+void correctDrift(const msg_result_t& result, const uint8_t* data,
+                  uint64_t toa) {
+    uint32_t txLatency;
+    if (!packetTxLatency(data, result.length, &txLatency))
+        return;
+
+    const int64_t slotStart = result.nextAlarm - result.period;
+    const int64_t offset =
+        (result.loraEndTime - slotStart) - (int64_t)(txLatency + toa);
+
+    if (!_driftState.hasBaseline) {
+        _driftState.baseline = offset;
+        _driftState.hasBaseline = true;
+        return;
+    }
+
+    // Mensagens atrasadas indicam que o relógio do receptor está adiantado,
+    // logo seu próximo slot deve ser estendido
+    int64_t step = (offset - _driftState.baseline) / DRIFT_GAIN;
+    step = constrain(step, -DRIFT_MAX_STEP, DRIFT_MAX_STEP);
+
+    if (step != 0) {
+        timerNudge(step);
+        _driftState.total += step;
+    }
+}
+
+/// Retorna o goodput efetivo do teste atual, em bits por segundo: os bits de
+/// payload recebidos com sucesso divididos pela duração dos slots do teste.
+float testGoodput(const test_stats_t& stats) {
+    const uint32_t messages = stats.ok + stats.corrupt + stats.lost;
+    if (messages == 0)
+        return 0;
+
+    const float duration = (float)messages * slotPeriod(_toa) / 1e6f;
+    return (float)stats.ok * _payloadLength * 8 / duration;
+}
+
+/// Gera o resumo do teste atual a partir de `_testStats`.
+log_summary_record_t testSummary() {
+    const test_stats_t& stats = _testStats;
+    log_summary_record_t summary = {
+        .type = kLogRecordSummary,
+        .node = _nodeId,
+        .test = _currentTest,
+        .ok = stats.ok,
+        .corrupt = stats.corrupt,
+        .lost = stats.lost,
+        .rssi = stats.rssi.mean,
+        .snr = stats.snr.mean,
+        .goodput = testGoodput(stats),
+        .energy = stats.energy,
+        .energyPerBit = energyPerBit(stats.energy, stats.ok, _payloadLength),
+        .rssiStddev = statsStddev(stats.rssi),
+        .snrStddev = statsStddev(stats.snr),
+        .rssiMin = stats.rssi.min,
+        .rssiMax = stats.rssi.max,
+        .snrMin = stats.snr.min,
+        .snrMax = stats.snr.max,
+    };
+
+    memcpy(summary.rssiHistogram, stats.rssiHistogram,
+           sizeof(summary.rssiHistogram));
+    memcpy(summary.snrHistogram, stats.snrHistogram,
+           sizeof(summary.snrHistogram));
+    return summary;
+}
+
+/// Insere uma entrada na fila de resultados e acorda a task do datalogger.
+void pushResult(const result_entry_t& entry) {
+    _logLatch |= !_resultQueue.push(entry);
+    logWake();
+}
+
+/// Insere os parâmetros do teste atual na fila de resultados. Deve ser
+/// executado antes da primeira mensagem de cada teste.
+void beginTestResults() {
+    result_entry_t entry;
+    entry.test = {
+        .type = kLogRecordTest,
+        .role = (uint8_t)_role,
+        .node = _nodeId,
+        .test = _currentTest,
+        .messages = MESSAGES_PER_TEST,
+        .power = _parameters.power,
+        .frequency = _parameters.frequency,
+        .preambleLength = _parameters.preambleLength,
+        .bandwidth = _parameters.bandwidth,
+        .sf = _parameters.sf,
+        .cr = _parameters.cr,
+        .crc = _parameters.crc,
+        .invertIq = _parameters.invertIq,
+        .boostedRxGain = _parameters.boostedRxGain,
+        .packetLength = _parameters.packetLength,
+        .syncWord = _parameters.syncWord,
+        .payloadLength = _payloadLength,
+    };
+
+    pushResult(entry);
+}
+
+/// Escreve as entradas da fila de resultados no cartão SD. Executa na task
+/// do datalogger.
+void writeResults() {
+    result_entry_t entry;
+    bool ended = false;
+
+    while (_resultQueue.pop(&entry)) {
+        // Os resumos e os parâmetros de um novo teste marcam o fim do teste
+        // anterior
+        ended |= entry.type != kLogRecordMessage;
+
+        // Os resumos dos receptores são gravados apenas no log binário, para
+        // não misturar linhas de outro formato ao CSV
+        if (entry.type == kLogRecordSummary) {
+            const log_summary_record_t& summary = entry.summary;
+
+            if (logBinary())
+                logWrite(&summary, sizeof(summary));
+
+            Serial.printf(
+                "Resumo do receptor %hhu, teste %u: %hu/%hu/%hu, RSSI "
+                "%.1f+-%.1f, SNR %.1f+-%.1f, goodput %.0f bit/s, %.3g "
+                "J/bit\n",
+                summary.node, summary.test, summary.ok, summary.corrupt,
+                summary.lost, summary.rssi, summary.rssiStddev, summary.snr,
+                summary.snrStddev, summary.goodput, summary.energyPerBit);
+            continue;
+        }
+
+        if (entry.type == kLogRecordTest) {
+            _logTest = entry.test;
+
+            // Gravar os parâmetros uma única vez por teste
+            if (logBinary()) {
+                logWrite(&entry.test, sizeof(entry.test));
+                continue;
             }
 
-            logPrintf("\n");
+            // Imprimir rótulo dos dados na primeira combinação
+            if (_logTest.test == 0) {
+                if (_role == kRx) {
+                    logPrintf(
+                        "Start Time,Rx End Time,End Time,Period,Alarm,"
+                        "Timer Latency,IRQ Latency,Parameter Index,Message "
+                        "Index,Tx Power (dBm),Spreading Factor,Coding "
+                        "Rate,Bandwidth (kHz),Frequency (MHz),RSSI (dBm),"
+                        "SNR (dB),Status,Node,Length,Payload Errors,"
+                        "Energy (J)\n");
+                } else {
+                    logPrintf(
+                        "Start Time,Tx End Time,End Time,Period,Alarm,"
+                        "Timer Latency,IRQ Latency,Parameter Index,Message "
+                        "Index,Tx Power (dBm),Spreading Factor,Coding "
+                        "Rate,Bandwidth (kHz),Frequency (MHz),Status,"
+                        "Energy (J)\n");
+                }
+            }
+
+            continue;
+        }
+
+        const msg_result_t& result = entry.message;
+        const log_test_record_t& param = _logTest;
+
+        // Gravar o resultado sem nenhuma formatação
+        if (logBinary()) {
+            logWrite(&result, sizeof(result));
+        } else if (_role == kRx) {
+            // Imprimir todas as informações para resultados do receptor
+            logPrintf(
+                "%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%hhd,%hhu,%hhu,%f,%f,%hi,"
+                "%f,%u,%hhu,%hhu,%hhu,%g\n",
+                result.startTime, result.loraEndTime, result.endTime,
+                result.period, result.nextAlarm, result.timerLatency,
+                result.irqLatency, param.test, result.index, param.power,
+                param.sf, param.cr, param.bandwidth, result.frequency,
+                result.rssi, result.snr, result.error, param.node,
+                result.length, result.payloadErrors, result.energy);
         } else if (_role == kTx) {
             // Imprimir poucas informações para o transmissor (não possui
             // RSSI/SNR)
-            logPrintf("%llu,%llu,%llu,%llu,%llu,%u,%u,%hhu,%hhu,%hhu,%f,%u\n",
-                      result.startTime, result.loraEndTime, result.endTime,
-                      result.period, result.nextAlarm, _currentTest, i,
-                      _parameters.power, _parameters.sf, _parameters.cr,
-                      _parameters.bandwidth, result.error);
+            logPrintf(
+                "%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%hhu,%hhu,%hhu,%f,%f,"
+                "%u,%g\n",
+                result.startTime, result.loraEndTime, result.endTime,
+                result.period, result.nextAlarm, result.timerLatency,
+                result.irqLatency, param.test, result.index, param.power,
+                param.sf, param.cr, param.bandwidth, result.frequency,
+                result.error, result.energy);
         }
     }
 
-    // Resetar vetor de resultados
-    memset(_results, 0, sizeof(_results));
+    // Gravar o buffer do datalogger apenas ao fim de cada teste, para que os
+    // resultados de cada mensagem sejam acumulados em blocos maiores
+    if (ended)
+        logFlush();
+}
+
+/// Imprime e zera os histogramas de `hal/probe.hh`. Executa na task do
+/// datalogger.
+void dumpProbes(const void* _, uint32_t test) {
+    probeDump(test);
+}
+
+/// Grava o checkpoint do cronograma com o próximo teste, ou zero após o
+/// último teste. Executa na task do datalogger, após os resultados do teste
+/// serem gravados, para que a escrita na memória flash não atrase o slot.
+/// Os registros ainda no buffer do datalogger são gravados antes, já que o
+/// teste retomado não os escreve novamente.
+void writeCheckpoint(const void* _, uint32_t test) {
+    logSync();
+    _preferences.putUInt("sweep", _sweepId);
+    _preferences.putUInt("test", test);
+}
+
+/// Quantidade de testes seguidos em que o receptor não recebeu nenhuma
+/// mensagem.
+uint8_t _silentTests = 0;
+
+/// Setada com "true" pela task do timer quando o receptor deve voltar a
+/// esperar a sincronização do transmissor.
+volatile bool _resyncRequested = false;
+
+/// Reconfigura o radiotransmissor para a próxima combinação de parâmetros.
+void nextTestLoop() {
+    _nextAlarm = timerNextTick();
+    _currentPeriod = timerPeriod();
+    _operationBegin = timerTime();
+
+    // Comparar o uso medido do slot com o reservado pelo modelo, permitindo
+    // ajustar a margem de segurança de `slot_timing_t`.
+    const uint64_t toa = _toa;
+    const uint64_t loraBudget = _slotTiming.txDelay + toa +
+                                (toa * _slotTiming.excessPermille) / 1000;
 
-    logFlush();
+    logDebugPrintf(
+        "slot SF%hhu/%.1fkHz: period: %llu, lora: %lld/%llu, processing: "
+        "%lld/%u, drift: %lld, goodput: %.0f\n",
+        _parameters.sf, _parameters.bandwidth, slotPeriod(toa), _slotMaxLora,
+        loraBudget, _slotMaxProcessing, _slotTiming.processing,
+        _driftState.total, testGoodput(_testStats));
+
+    // Imprimir os histogramas do teste fora da task do timer
+    logSubmit(dumpProbes, NULL, _currentTest);
+
+    // Gravar o resumo do teste no log do próprio receptor
+    if (_role == kRx) {
+        result_entry_t entry;
+        entry.summary = testSummary();
+        pushResult(entry);
+
+        // Voltar à sincronização caso o transmissor pareça ter parado
+        const bool silent = _testStats.ok + _testStats.corrupt == 0;
+        _silentTests = silent ? _silentTests + 1 : 0;
+        _resyncRequested |= _silentTests >= SYNC_LOST_TESTS;
+    }
 
     // Resetar parâmetros de teste
     _messageIndex = 0;
     _currentTest++;
+    _slotMaxLora = 0;
+    _slotMaxProcessing = 0;
+    _uplinkSlot = 0;
+    _feedbackStop = false;
+    _feedbackDone = false;
+    _testStats = {};
+    _driftState.hasBaseline = false;
 
     // Marcar o timer para resincronização e iniciar próximo teste
     _protoState = updateTestParameters() ? kFinished : kRunning;
-    timerResync(radioTransmitTime(_parameters, _messageLength) + BUDGET,
-                timedLoop);
 
-    // Finalizar log do receptor após o último teste
+    if (_protoState == kRunning && beaconDue())
+        timerResync(beaconPeriod(), beaconLoop);
+    else
+        timerResync(slotPeriod(_toa), timedLoop);
+
+    if (_protoState == kRunning)
+        beginTestResults();
+
+    // Gravar o checkpoint após os resultados do teste anterior
+    if (_role == kTx)
+        logSubmit(writeCheckpoint, NULL, _currentTest);
+
+    // Finalizar log após o último teste, aguardando a escrita dos resultados
     if (_protoState == kFinished) {
-        logClose();
         timerStop();
+        logClose();
     }
 
     _operationEnd = _timedEnd = timerTime();
-    _timerLatch |= (_timedEnd - _operationBegin) > _currentPeriod;
+    _timerLatch |= (uint64_t)(_timedEnd - _operationBegin) > _currentPeriod;
+    publishSnapshot();
 
     // Imprimir informações de timing para debugging
     logDebugPrintf(
@@ -486,16 +1725,215 @@ void sdLoop() {
         (_timedEnd - _operationBegin), _currentPeriod, _nextAlarm);
 }
 
+/// Retorna `true` caso o teste atual comece com um slot de beacon.
+bool beaconDue() {
+    return _currentTest % SYNC_BEACON_INTERVAL == 0;
+}
+
+/// Retorna o instante, a partir do início do slot de beacon do transmissor,
+/// em que o pacote de sincronização é enviado. Inclui a reconfiguração do
+/// radio antes do cabeçalho e antes da descrição.
+uint64_t beaconMarkOffset() {
+    return 2 * _slotTiming.processing + _controlToa.syncHeader +
+           _controlToa.syncSpec + 2 * SYNC_GAP * 1000;
+}
+
+/// Retorna o período do slot de beacon. Como em `syncLoop`, um receptor que
+/// recebe o beacon inicia o teste um período após o fim do pacote de
+/// sincronização, e o transmissor `txDelay` depois. Os receptores já
+/// sincronizados estão `txDelay` adiantados, logo o slot tem a mesma duração
+/// em todos os aparelhos.
+uint64_t beaconPeriod() {
+    return beaconMarkOffset() + _controlToa.syncMark + slotPeriod(_toa) +
+           _slotTiming.txDelay;
+}
+
+/// Executa o slot de beacon, em que o transmissor envia a sincronização com
+/// o teste atual, da mesma forma que em `syncLoop`. Os receptores já
+/// sincronizados apenas aguardam o teste, e os que esperam em `syncLoop`
+/// passam a participar.
+void beaconLoop() {
+    _nextAlarm = timerNextTick();
+    _currentPeriod = timerPeriod();
+    _operationBegin = timerTime();
+
+    timerResync(slotPeriod(_toa), timedLoop);
+
+    radio_error_t error = kNone;
+
+    // O fim do pacote de sincronização deve estar no instante esperado
+    // pelos receptores já sincronizados
+    if (_role == kTx) {
+        const int64_t markTime =
+            (_nextAlarm - _currentPeriod) + beaconMarkOffset();
+
+        error = sendSync(_currentTest, markTime);
+        radioSetParameters(_parameters);
+    }
+
+    _operationEnd = _timedEnd = timerTime();
+    _timerLatch |= (uint64_t)(_timedEnd - _operationBegin) > _currentPeriod;
+
+    publishSnapshot();
+
+    logDebugPrintf("beacon %u: e%d, budget_used: %lld, period: %llu\n",
+                   _currentTest, error, (_timedEnd - _operationBegin),
+                   _currentPeriod);
+}
+
+/// Interrompe o experimento e volta a esperar a sincronização, que pode ser o
+/// beacon de um teste seguinte ou a sincronização inicial de um transmissor
+/// reiniciado. O log continua em um novo arquivo. `timerStop` aguarda o fim
+/// do slot atual, logo a task do timer não usa mais o radiotransmissor nem o
+/// log a seguir.
+void restartSync() {
+    timerStop();
+    logClose();
+    uiTaskStop();
+    radioDisarm();
+
+    _parameters = _syncParameters;
+    _toa = radioTransmitTime(_parameters, _payloadLength);
+    _messageIndex = 0;
+    _slotMaxLora = 0;
+    _slotMaxProcessing = 0;
+    _uplinkSlot = 0;
+    _feedbackStop = false;
+    _feedbackDone = false;
+    _testStats = {};
+    _driftState = {};
+    _silentTests = 0;
+    _resyncRequested = false;
+    _protoState = kUninitialized;
+}
+
+/// Setada com "true" pela task da interface quando o usuário pedir para
+/// parar o experimento.
+volatile bool _stopRequested = false;
+
+/// O último estado publicado pela task do timer para a interface.
+ui_snapshot_t _snapshot;
+portMUX_TYPE _snapshotLock = portMUX_INITIALIZER_UNLOCKED;
+
+/// Copia o estado atual do experimento.
+ui_snapshot_t takeSnapshot() {
+    return ui_snapshot_t {
+        .parameters = _parameters,
+        .test = _currentTest,
+        .payloadLength = _payloadLength,
+        .toa = _toa,
+        .ok = _testsOk,
+        .corrupt = _testsCorrupt,
+        .lost = _testsLost,
+        .rssi = radioRSSI(),
+        .snr = radioSNR(),
+        .rssiStats = _testStats.rssi,
+        .snrStats = _testStats.snr,
+        .operationBegin = _operationBegin,
+        .operationEnd = _operationEnd,
+        .timedEnd = _timedEnd,
+        .period = _currentPeriod,
+        .resultMessage = _resultMessage,
+        .timerLatch = _timerLatch,
+        .logLatch = _logLatch,
+    };
+}
+
+/// Publica o estado atual do experimento para a task da interface. Deve ser
+/// executado ao fim de cada slot.
+void publishSnapshot() {
+    const ui_snapshot_t snapshot = takeSnapshot();
+
+    portENTER_CRITICAL(&_snapshotLock);
+    _snapshot = snapshot;
+    portEXIT_CRITICAL(&_snapshotLock);
+}
+
+/// Desenha um frame da interface durante o experimento. Executa na task da
+/// interface, a partir do último estado publicado.
+void drawRunningFrame() {
+    portENTER_CRITICAL(&_snapshotLock);
+    const ui_snapshot_t state = _snapshot;
+    portEXIT_CRITICAL(&_snapshotLock);
+
+    uiLoop();
+
+    if (uiButtonState())
+        _stopRequested = true;
+
+    // Desenhar interface, exibindo o RSSI e SNR apenas para o receptor
+    uiClear();
+    drawTestOverlay(NULL, _role == kRx, false, state);
+    uiAlign(kLeft);
+
+    // Imprimir uma barra de progresso com as atividades
+    // executadas entre os timeouts do timer.
+    const int16_t barWidth = 128 - 10;
+    uiRect(5, 15, barWidth, 14, kStroke, kWhite);
+
+    // Imprimir o restante do budget até o próximo timer
+    int64_t now = timerTime();
+    int64_t nextTick = timerNextTick();
+    uint64_t period = timerPeriod();
+
+    const double slot = state.period;
+    double pctOpBegin = 0;
+    double pctOpEnd = (state.operationEnd - state.operationBegin) / slot;
+    double pctFunctionEnd = (state.timedEnd - state.operationBegin) / slot;
+    double pctNow = (now - state.operationBegin) / slot;
+
+    // Previne barras de progresso inválidas
+    pctOpBegin = constrain(pctOpBegin, 0.0, 1.0);
+    pctOpEnd = constrain(pctOpEnd, 0.0, 1.0);
+    pctFunctionEnd = constrain(pctFunctionEnd, 0.0, 1.0);
+    pctNow = constrain(pctNow, 0.0, 1.0);
+
+    // Barra branca expressando o tempo total consumido pela
+    // função `timedLoop`
+    uiRect(5 + pctOpBegin * barWidth, 15,
+           (pctFunctionEnd - pctOpBegin) * barWidth, 14, kFill, kWhite);
+
+    // Barra semi-transparente expressando o tempo total
+    // consumido esperando.
+    uiRect(5 + pctFunctionEnd * barWidth, 15,
+           (pctNow - pctFunctionEnd) * barWidth, 14, kDither, kWhite);
+
+    const char* status = state.resultMessage;
+    if (state.timerLatch)
+        status = "(desync!)";
+    else if (state.logLatch)
+        status = "(log lento!)";
+
+    uiText(10, 15, status, kBlack);
+
+    uiAlign(kRight);
+
+    char buffer[256];
+    printMinimalPeriod(buffer, 256, period - (nextTick - now), period);
+
+    uiText(10, 15, buffer, kBlack);
+    uiFinish();
+}
+
 /// Executa quando todos os testes forem finalizados.
 void finishedLoop() {
+    // Voltar a desenhar a interface nesta task
+    uiTaskStop();
+
+    if (!_uiEnabled) {
+        delay(1000);
+        return;
+    }
+
     uiClear();
-    drawTestOverlay(NULL, false, false);
+    drawTestOverlay(NULL, false, false, takeSnapshot());
     uiAlign(kCenter);
 
     uiText(0, 15, "Testes finalizados!");
     uiFinish();
 }
 
+#ifndef FIXED_ROLE
 /// Executa um simples loop, em que um receptor contínuamente recebe
 /// mensagens de um transmissor no mesmo parâmetro.
 void pingLoop() {
@@ -520,7 +1958,7 @@ void pingLoop() {
 
     // Desenhar interface antes da operação LoRa
     uiClear();
-    drawTestOverlay(NULL, _role == kRx, true);
+    drawTestOverlay(NULL, _role == kRx, true, takeSnapshot());
 
     const char* statusText;
     switch (error) {
@@ -549,7 +1987,7 @@ void pingLoop() {
     uiText(0, 15, buffer);
     uiFinish();
 
-    uint8_t message[] = { _currentTest };
+    uint8_t message[] = { (uint8_t)_currentTest };
     uint8_t length = sizeof(message) / sizeof(uint8_t);
 
     // Enviar/receber ping dependendo do cargo selecionado
@@ -562,18 +2000,171 @@ void pingLoop() {
         delay(1000);
     }
 }
+#endif
+
+#ifdef LOOPBACK
+/// Filas entre a task do transmissor (`loop`) e a task do receptor. Como
+/// o transmissor aguarda o resultado de cada mensagem antes de enviar a
+/// próxima, as filas nunca ficam cheias.
+spsc_queue_t<loopback_command_t, 4> _loopbackCommands;
+spsc_queue_t<loopback_result_t, 8> _loopbackResults;
+
+static struct {
+    TaskHandle_t task;
+
+    /// O instante do início do cronograma.
+    int64_t begin;
+} _loopbackState;
+
+/// Task do receptor do loopback, no núcleo oposto ao do transmissor: para
+/// cada comando, aplica os parâmetros ao módulo externo e recebe as
+/// mensagens do teste, enviando o resultado de cada uma.
+void _loopbackRxTask(void* _) {
+    static uint8_t buffer[PACKET_MAX_LENGTH];
+    loopback_command_t command;
+
+    while (1) {
+        if (!_loopbackCommands.pop(&command)) {
+            vTaskDelay(1);
+            continue;
+        }
+
+        radioAuxSetParameters(command.parameters);
+
+        uint8_t length = sizeof(buffer);
+        radioAuxStartRecv(buffer, &length, command.timeout);
+        _loopbackResults.push({ .index = LOOPBACK_READY });
+
+        for (uint16_t i = 0; i < command.messages; i++) {
+            loopback_result_t result = {
+                .index = i,
+                .error = radioAuxWait(),
+                .rssi = radioAuxRSSI(),
+                .snr = radioAuxSNR(),
+                .end = radioAuxIRQTime(),
+            };
+
+            if (result.error == kNone && packetValidate(buffer, length, i))
+                result.error = kCrc;
+
+            // Voltar a receber antes de liberar a próxima mensagem
+            length = sizeof(buffer);
+            if (i + 1 < command.messages)
+                radioAuxStartRecv(buffer, &length, command.timeout);
+
+            _loopbackResults.push(result);
+        }
+    }
+}
+
+/// Aguarda o próximo resultado da task do receptor.
+loopback_result_t _loopbackWait() {
+    loopback_result_t result;
+
+    while (!_loopbackResults.pop(&result))
+        taskYIELD();
+
+    return result;
+}
+
+/// Executa um teste do cronograma no modo de loopback. O transmissor envia
+/// cada mensagem assim que o receptor volta a receber, e, como os dois
+/// radios usam o mesmo relógio, o atraso entre o fim da transmissão e o fim
+/// da recepção é medido diretamente.
+void loopbackLoop() {
+    if (_loopbackState.task == NULL) {
+        if (!radioAuxInit()) {
+            Serial.println("Erro ao inicializar o segundo radio");
+            _protoState = kFinished;
+            return;
+        }
+
+        buildSchedule();
+        _currentTest = 0;
+        _loopbackState.begin = timerTime();
+
+        xTaskCreatePinnedToCore(_loopbackRxTask, "loopback", 8192, NULL,
+                                tskIDLE_PRIORITY + 10, &_loopbackState.task,
+                                xPortGetCoreID() == 0 ? 1 : 0);
+    }
+
+    updateTestParameters();
+
+    const loopback_command_t command = {
+        .parameters = _parameters,
+        .messages = MESSAGES_PER_TEST,
+        .timeout = _toa + (_toa * LORA_EXCESS_PERMILLE) / 1000 + SYNC_GUARD,
+    };
+
+    _loopbackCommands.push(command);
+    _loopbackWait();
+
+    running_stats_t rssi = {};
+    running_stats_t snr = {};
+    running_stats_t delay = {};
+    uint16_t ok = 0, corrupt = 0, lost = 0;
+    const int64_t begin = timerTime();
+
+    for (uint16_t i = 0; i < command.messages; i++) {
+        const radio_error_t error = radioSend(packetFrame(i), packetLength());
+        const int64_t txEnd = radioIRQTime();
+        const loopback_result_t result = _loopbackWait();
+
+        if (error != kNone || result.error == kTimeout) {
+            lost++;
+        } else if (result.error != kNone) {
+            corrupt++;
+        } else {
+            ok++;
+            statsAdd(&rssi, result.rssi);
+            statsAdd(&snr, result.snr);
+            statsAdd(&delay, result.end - txEnd);
+        }
+    }
+
+    const float seconds = (timerTime() - begin) / 1e6f;
+    const float goodput = ok * _payloadLength * 8 / seconds;
+
+    Serial.printf("Loopback, teste %u: %hu/%hu/%hu, RSSI %.1f+-%.1f, SNR "
+                  "%.1f+-%.1f, atraso %.0f+-%.0f us (max %.0f), goodput "
+                  "%.0f bit/s\n",
+                  _currentTest, ok, corrupt, lost, rssi.mean,
+                  statsStddev(rssi), snr.mean, statsStddev(snr), delay.mean,
+                  statsStddev(delay), delay.max, goodput);
+
+    if (_uiEnabled) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "Loopback %u/%u", _currentTest + 1,
+                 (unsigned)_scheduleLength);
+
+        uiClear();
+        uiAlign(kCenter);
+        uiText(0, 15, buffer);
+        uiFinish();
+    }
+
+    if (++_currentTest < _scheduleLength)
+        return;
+
+    Serial.printf("Loopback finalizado em %.1f s\n",
+                  (timerTime() - _loopbackState.begin) / 1e6f);
+    _protoState = kFinished;
+}
+#endif
 
 void loop() {
     halLoop();
 
+#ifndef FIXED_ROLE
     // Desenhar tela de seleção de cargo antes de iniciar o protocolo
-    if (_role == kUnspecified) {
+    if (_role == kUnspecified && _protoState == kUninitialized) {
         const uint32_t rate = 1000 / 20;
         uint32_t start = millis();
 
         uiLoop();
         uiClear();
-        drawTestOverlay("Selecione o cargo", false, false);
+        drawTestOverlay("Selecione o cargo", false, false,
+                        takeSnapshot());
         uiAlign(kCenter);
 
         if (uiButton(-30, 20, "Transmissor"))
@@ -594,87 +2185,58 @@ void loop() {
 
         uiFinish();
 
+#ifdef HEADLESS
+        // Iniciar sem o menu nos próximos boots
+        if (_role != kUnspecified && _protoState != kPing)
+            _preferences.putUChar("role", _role);
+#endif
+
         // Esperar o suficiente para uma taxa de 20FPS
         uint32_t time = millis() - start;
         delay(time >= rate ? 0 : rate - time);
         return;
     }
+#endif
 
     if (_protoState == kUninitialized)
         return syncLoop();
+#ifndef FIXED_ROLE
     else if (_protoState == kPing)
         return pingLoop();
+#endif
+#ifdef LOOPBACK
+    else if (_protoState == kLoopback)
+        return loopbackLoop();
+#endif
     else if (_protoState == kRunning) {
-        static uint32_t _renderFrame = 0;
-
-        // Renderizar a cada 4 execuções do `loop`
-        if (!radioBusy() && _renderFrame++ == 12) {
-            _renderFrame = 0;
-
-            // Desenhar interface, exibindo o RSSI e SNR apenas para o
-            // receptor
-            uiLoop();
-
-            // Parar o experimento caso o usuário aperte o botão durante
-            // a transmissão.
-            if (uiButtonState()) {
-                Serial.println("Parando...");
-                logClose();
-                timerStop();
-                _protoState = kFinished;
-                return;
-            }
+        // A interface é desenhada pela task da interface. Parar o
+        // experimento caso o usuário aperte o botão durante a transmissão.
+        // Sem a interface, o botão é lido aqui
+        if (!_uiEnabled) {
+            uiUpdateButton();
+            _stopRequested |= uiButtonState();
+        }
+
+        if (_stopRequested) {
+            Serial.println("Parando...");
+
+            // Aguardar o fim do slot atual antes de fechar o log
+            timerStop();
+            logClose();
+
+            // Não retomar um experimento parado pelo usuário
+            writeCheckpoint(NULL, 0);
+            _protoState = kFinished;
+            return;
+        }
 
-            uiClear();
-            drawTestOverlay(NULL, _role == kRx, false);
-            uiAlign(kLeft);
-
-            // Imprimir uma barra de progresso com as atividades
-            // executadas entre os timeouts do timer.
-            const int16_t barWidth = 128 - 10;
-            uiRect(5, 15, barWidth, 14, kStroke, kWhite);
-
-            // Imprimir o restante do budget até o próximo timer
-            int64_t now = timerTime();
-            int64_t nextTick = timerNextTick();
-            uint64_t period = timerPeriod();
-
-            double pctOpBegin = (_begin - _begin) / (double)(_currentPeriod);
-            double pctOpEnd =
-                (_operationEnd - _operationBegin) / (double)(_currentPeriod);
-            double pctFunctionEnd =
-                (_timedEnd - _operationBegin) / (double)(_currentPeriod);
-            double pctNow =
-                (timerTime() - _operationBegin) / (double)(_currentPeriod);
-
-            // Previne barras de progresso inválidas
-            pctOpBegin = constrain(pctOpBegin, 0.0, 1.0);
-            pctOpEnd = constrain(pctOpEnd, 0.0, 1.0);
-            pctFunctionEnd = constrain(pctFunctionEnd, 0.0, 1.0);
-            pctNow = constrain(pctNow, 0.0, 1.0);
-
-            // Barra branca expressando o tempo total consumido pela
-            // função `timedLoop`
-            uiRect(5 + pctOpBegin * barWidth, 15,
-                   (pctFunctionEnd - pctOpBegin) * barWidth, 14, kFill, kWhite);
-
-            // Barra semi-transparente expressando o tempo total
-            // consumido esperando.
-            uiRect(5 + pctFunctionEnd * barWidth, 15,
-                   (pctNow - pctFunctionEnd) * barWidth, 14, kDither, kWhite);
-
-            uiText(10, 15, _timerLatch ? "(desync!)" : _resultMessage, kBlack);
-
-            uiAlign(kRight);
-
-            char buffer[256];
-            printMinimalPeriod(buffer, 256, period - (nextTick - now), period);
-
-            uiText(10, 15, buffer, kBlack);
-            uiFinish();
+        if (_resyncRequested) {
+            Serial.println("Sem mensagens, esperando sync...");
+            restartSync();
+            return;
         }
 
-        yield();
+        delay(20);
     } else if (_protoState == kFinished)
         return finishedLoop();
 }
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Compila o simulador de `host/sim.cpp` em `_host_build/sweepsim`. Opções do
+# sketch podem ser definidas em CXXFLAGS (ex. `CXXFLAGS=-DLOW_POWER`).
+#
+# Os includes do sketch são relativos ao diretório do sketch, logo o sketch e
+# os headers são copiados para `_host_build`, com os módulos simulados de
+# `host/hal` no lugar dos módulos de hardware.
+set -e
+
+cd "$(dirname "$0")/.."
+
+BUILD=_host_build
+mkdir -p "$BUILD/hal"
+
+# Módulos que não dependem do hardware são usados sem modificações
+cp hal/buttons.hh hal/lib.hh hal/log_format.hh hal/probe.hh \
+    hal/radio_params.hh hal/spsc.hh "$BUILD/hal/"
+cp host/hal/*.hh "$BUILD/hal/"
+cp energy.hh packet.hh schedule.hh stats.hh "$BUILD/"
+
+python3 host/prototypes.py heltec-lora-test.ino > "$BUILD/sketch.cpp"
+
+${CXX:-g++} -std=gnu++17 -O2 -Wall -Wno-unused-function \
+    ${CXXFLAGS} \
+    -Ihost/include -I"$BUILD" -o "$BUILD/sweepsim" host/sim.cpp
@@ -0,0 +1,176 @@
+/**
+ * host/hal/log.hh
+ *
+ * Datalogger simulado, com a mesma interface de `hal/log.hh`. O cartão SD é
+ * um diretório do computador, e os trabalhos da task do datalogger são
+ * executados imediatamente, sem avançar o relógio simulado, já que a task
+ * executa no outro núcleo.
+ */
+
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+
+#include "log_format.hh"
+#include "probe.hh"
+#include "sim.hh"
+
+#define LOG_DEBUG
+#define LOG_BINARY
+
+#ifdef LOG_BINARY
+#define LOG_FILENAME "/log.bin"
+#else
+#define LOG_FILENAME "/log.txt"
+#endif
+
+using log_job_fn = void (*)(const void* data, uint32_t arg);
+using log_consumer_fn = void (*)(void);
+
+/// O diretório usado como cartão SD. Definido pelo simulador.
+std::string _logRoot = ".";
+
+FILE* _logFile = NULL;
+log_consumer_fn _logConsumer = NULL;
+
+// Mede o tempo real gasto em uma escrita.
+struct _log_timer_t {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    ~_log_timer_t() {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        _simStats.logHostNanos +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count();
+    }
+};
+
+void logTaskStart() {}
+
+/// Executa o consumidor antes do trabalho, como a task do datalogger.
+bool logSubmit(log_job_fn fn, const void* data, uint32_t arg = 0) {
+    if (_logConsumer)
+        _logConsumer();
+
+    fn(data, arg);
+    return true;
+}
+
+bool logTryLock() {
+    return true;
+}
+
+void logUnlock() {}
+
+void logSetConsumer(log_consumer_fn fn) {
+    _logConsumer = fn;
+}
+
+void logWake() {
+    if (_logConsumer)
+        _logConsumer();
+}
+
+void logDrain() {
+    logWake();
+}
+
+bool logInit(const char* filename) {
+    _logFile = fopen((_logRoot + filename).c_str(), "ab");
+    if (!_logFile)
+        return false;
+
+#ifdef LOG_BINARY
+    if (ftell(_logFile) == 0) {
+        const log_file_header_t header = {
+            .magic = LOG_FORMAT_MAGIC,
+            .version = LOG_FORMAT_VERSION,
+        };
+
+        fwrite(&header, sizeof(header), 1, _logFile);
+    }
+#endif
+
+    return true;
+}
+
+bool logBinary() {
+#ifdef LOG_BINARY
+    return _logFile != NULL;
+#else
+    return false;
+#endif
+}
+
+size_t logWrite(const void* data, size_t size) {
+    if (!_logFile)
+        return 0;
+
+    _log_timer_t timer;
+    const size_t written = fwrite(data, 1, size, _logFile);
+    _simStats.logBytes += written;
+    _simStats.logWrites++;
+    return written;
+}
+
+int logPrintf(const char* format, ...) {
+    va_list list;
+    va_start(list, format);
+
+    int res = 0;
+
+    if (_logFile) {
+        _log_timer_t timer;
+        res = vfprintf(_logFile, format, list);
+        _simStats.logBytes += res > 0 ? res : 0;
+        _simStats.logWrites++;
+    } else {
+        res = Serial.vprintf(format, list);
+    }
+
+    va_end(list);
+    return res;
+}
+
+bool logReadFile(const char* filename, char* dest, size_t size) {
+    FILE* file = fopen((_logRoot + filename).c_str(), "rb");
+    if (!file)
+        return false;
+
+    const size_t length = fread(dest, 1, size - 1, file);
+    fclose(file);
+
+    dest[length] = '\0';
+    return true;
+}
+
+bool logFlush() {
+    if (_logFile)
+        fflush(_logFile);
+
+    return false;
+}
+
+bool logSync() {
+    return logFlush();
+}
+
+#ifdef LOG_DEBUG
+#define logDebugPrintf(format, ...) Serial.printf(format, __VA_ARGS__)
+#else
+#define logDebugPrintf(format, ...) 0
+#endif
+
+void logClose() {
+    logDrain();
+
+    if (_logFile)
+        fclose(_logFile);
+
+    _logFile = NULL;
+}
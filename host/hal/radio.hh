@@ -0,0 +1,341 @@
+/**
+ * host/hal/radio.hh
+ *
+ * Radiotransmissor simulado, com a mesma interface de `hal/radio.hh`. As
+ * operações não bloqueiam o computador: `radioWait` avança o relógio
+ * simulado até o fim do ToA do pacote, calculado pelo mesmo modelo de ToA
+ * do experimento, e os pacotes recebidos são gerados por `simReceive`.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "probe.hh"
+#include "radio_params.hh"
+#include "sim.hh"
+
+#define RADIOLIB_SX126X_MAX_PACKET_LENGTH 255
+
+/// Timeout usado nas recepções sem timeout, para que a simulação termine
+/// caso nenhum pacote chegue.
+#define SIM_RX_FOREVER 60000000
+
+using radio_callback_fn = void (*)(radio_error_t);
+
+enum radio_operation_t {
+    kRadioIdle,
+    kRadioSending,
+    kRadioReceiving,
+};
+
+static struct {
+    radio_operation_t operation;
+    radio_callback_fn callback;
+
+    uint8_t* dest;
+    uint8_t* length;
+
+    radio_error_t result;
+    int16_t rssi;
+    float snr;
+    int64_t irqLatency;
+
+    /// A operação preparada, o timeout da recepção e o comprimento do
+    /// pacote carregado.
+    radio_operation_t armed;
+    uint64_t armedTimeout;
+    uint8_t armedSize;
+
+    /// Instante do fim da operação atual e o seu resultado.
+    int64_t end;
+    radio_error_t pending;
+
+    /// `true` caso o radiotransmissor esteja em sleep, desde o instante dado.
+    bool asleep;
+    int64_t sleepStart;
+} _radioState;
+
+static struct {
+    radio_parameters_t parameters;
+    bool valid;
+} _radioApplied;
+
+bool radioInit() {
+    _radioState = {};
+    _radioApplied.valid = false;
+    return true;
+}
+
+// Simula um comando SPI que transfere `bytes` bytes.
+void _radioCommand(uint32_t bytes = 0) {
+    const int64_t cost = SIM_SPI_COMMAND + SIM_SPI_BYTE * bytes;
+    simAdvance(cost);
+    _simStats.radioCommands += cost;
+}
+
+void radioSleep() {
+    if (_radioState.operation != kRadioIdle || _radioState.asleep)
+        return;
+
+    _radioCommand();
+    _radioState.armed = kRadioIdle;
+    _radioState.asleep = true;
+    _radioState.sleepStart = _simTime;
+}
+
+int64_t radioWake() {
+    if (!_radioState.asleep)
+        return 0;
+
+    _simStats.radioSleep += _simTime - _radioState.sleepStart;
+    _radioState.asleep = false;
+
+    simAdvance(SIM_RADIO_WAKE);
+    probeRecord(kProbeRadioWake, SIM_RADIO_WAKE);
+    return SIM_RADIO_WAKE;
+}
+
+// Inicia a operação dada a partir do instante atual.
+radio_error_t _radioBegin(radio_operation_t operation, uint8_t size,
+                          uint64_t timeout, radio_callback_fn fn) {
+    const radio_parameters_t& param = _radioApplied.parameters;
+    _radioCommand();
+
+    _radioState.operation = operation;
+    _radioState.callback = fn;
+
+    if (operation == kRadioSending) {
+        const int64_t toa = radioTransmitTime(param, size);
+        _radioState.end = _simTime + toa;
+        _radioState.pending = kNone;
+        _simStats.airtime += toa;
+        return kNone;
+    }
+
+    const uint64_t limit = timeout > 0 ? timeout : SIM_RX_FOREVER;
+    uint8_t length = *_radioState.length;
+    sim_packet_t packet = {};
+
+    if (simReceive(_radioState.dest, &length, &packet) &&
+        (uint64_t)packet.begin < limit) {
+        *_radioState.length = length;
+        _radioState.end = _simTime + packet.end;
+        _radioState.pending = kNone;
+        _radioState.rssi = packet.rssi;
+        _radioState.snr = packet.snr;
+        _simStats.airtime += radioTransmitTime(param, length);
+    } else {
+        _radioState.end = _simTime + limit;
+        _radioState.pending = kTimeout;
+    }
+
+    return kNone;
+}
+
+radio_error_t radioStartSend(const uint8_t* message, uint8_t size,
+                             radio_callback_fn fn = NULL) {
+    radioWake();
+    const int64_t start = probeNow();
+    _radioState.armed = kRadioIdle;
+
+    // Carregar o pacote no buffer do radiotransmissor
+    _radioCommand(size);
+    radio_error_t error = _radioBegin(kRadioSending, size, 0, fn);
+    probeSince(kProbeRadioStart, start);
+    return error;
+}
+
+radio_error_t radioStartRecv(uint8_t* dest, uint8_t* length,
+                             uint64_t timeout = 0,
+                             radio_callback_fn fn = NULL) {
+    radioWake();
+    const int64_t start = probeNow();
+    _radioState.armed = kRadioIdle;
+    _radioState.dest = dest;
+    _radioState.length = length;
+
+    radio_error_t error = _radioBegin(kRadioReceiving, 0, timeout, fn);
+    probeSince(kProbeRadioStart, start);
+    return error;
+}
+
+radio_error_t radioArmSend(const uint8_t* message, uint8_t size) {
+    radioWake();
+    _radioCommand(size);
+    _radioState.armed = kRadioSending;
+    _radioState.armedSize = size;
+    return kNone;
+}
+
+radio_error_t radioPatchArmed(uint8_t offset, const void* data, uint8_t size) {
+    if (_radioState.armed != kRadioSending)
+        return kUnknown;
+
+    _radioCommand(size);
+    return kNone;
+}
+
+radio_error_t radioArmRecv(uint8_t* dest, uint8_t* length,
+                           uint64_t timeout = 0) {
+    radioWake();
+    _radioCommand();
+    _radioState.armed = kRadioReceiving;
+    _radioState.dest = dest;
+    _radioState.length = length;
+    _radioState.armedTimeout = timeout;
+    return kNone;
+}
+
+bool radioArmed() {
+    return _radioState.armed != kRadioIdle;
+}
+
+void radioDisarm() {
+    _radioState.armed = kRadioIdle;
+}
+
+radio_error_t radioFire(radio_callback_fn fn = NULL) {
+    const int64_t start = probeNow();
+    const radio_operation_t operation = _radioState.armed;
+
+    if (operation == kRadioIdle)
+        return kUnknown;
+
+    _radioState.armed = kRadioIdle;
+    radio_error_t error = _radioBegin(operation, _radioState.armedSize,
+                                      _radioState.armedTimeout, fn);
+    probeSince(kProbeRadioStart, start);
+    return error;
+}
+
+bool radioPending() {
+    return _radioState.operation != kRadioIdle;
+}
+
+// Finaliza a operação atual no instante atual.
+radio_error_t _radioFinish() {
+    _radioState.irqLatency = SIM_IRQ_LATENCY;
+    probeRecord(kProbeIrqLatency, SIM_IRQ_LATENCY);
+
+    // Ler o pacote recebido e voltar ao standby
+    const bool received = _radioState.operation == kRadioReceiving &&
+                          _radioState.pending == kNone;
+    _radioCommand(received ? *_radioState.length : 0);
+
+    radio_callback_fn fn = _radioState.callback;
+    _radioState.operation = kRadioIdle;
+    _radioState.callback = NULL;
+    _radioState.result = _radioState.pending;
+
+    if (fn)
+        fn(_radioState.result);
+
+    return _radioState.result;
+}
+
+bool radioPoll() {
+    if (_radioState.operation == kRadioIdle)
+        return true;
+
+    if (_simTime < _radioState.end + SIM_IRQ_LATENCY)
+        return false;
+
+    _radioFinish();
+    return true;
+}
+
+radio_error_t radioWait() {
+    if (_radioState.operation == kRadioIdle)
+        return _radioState.result;
+
+    simAdvanceTo(_radioState.end + SIM_IRQ_LATENCY);
+    return _radioFinish();
+}
+
+radio_error_t radioResult() {
+    return _radioState.result;
+}
+
+radio_error_t radioSend(const uint8_t* message, uint8_t size) {
+    radio_error_t error = radioStartSend(message, size);
+    return error != kNone ? error : radioWait();
+}
+
+radio_error_t radioRecv(uint8_t* dest, uint8_t* length, uint64_t timeout = 0) {
+    radio_error_t error = radioStartRecv(dest, length, timeout);
+    return error != kNone ? error : radioWait();
+}
+
+bool radioBusy() {
+    return false;
+}
+
+int64_t radioIRQLatency() {
+    return _radioState.irqLatency;
+}
+
+int64_t radioIRQTime() {
+    return _radioState.end;
+}
+
+int16_t radioRSSI() {
+    return _radioState.rssi;
+}
+
+float radioSNR() {
+    return _radioState.snr;
+}
+
+/// Simula os comandos enviados por `radioSetParameters` de `hal/radio.hh`:
+/// um comando por parâmetro modificado, e a calibração de imagem ao mudar a
+/// frequência.
+void radioSetParameters(const radio_parameters_t& param) {
+    const radio_parameters_t& last = _radioApplied.parameters;
+    const bool all = !_radioApplied.valid;
+    radioWake();
+
+    if (all || param.power != last.power)
+        _radioCommand(2);
+
+    if (all || param.bandwidth != last.bandwidth || param.sf != last.sf ||
+        param.cr != last.cr)
+        _radioCommand(8);
+
+    if (all || param.crc != last.crc ||
+        param.packetLength != last.packetLength ||
+        param.preambleLength != last.preambleLength ||
+        param.invertIq != last.invertIq)
+        _radioCommand(6);
+
+    if (all || param.boostedRxGain != last.boostedRxGain)
+        _radioCommand(3);
+
+    if (all || param.syncWord != last.syncWord)
+        _radioCommand(4);
+
+    if (all || param.frequency != last.frequency) {
+        _radioCommand(4);
+        simAdvance(SIM_CALIBRATION);
+        _simStats.radioCommands += SIM_CALIBRATION;
+        _simStats.calibrations++;
+    }
+
+    if (all || !radioParametersEqual(param, last))
+        _radioState.armed = kRadioIdle;
+
+    _radioApplied.parameters = param;
+    _radioApplied.valid = true;
+}
+
+radio_error_t radioHop(float frequency) {
+    radio_parameters_t& last = _radioApplied.parameters;
+
+    if (_radioApplied.valid && frequency == last.frequency)
+        return kNone;
+
+    radioWake();
+    _radioCommand(4);
+    last.frequency = frequency;
+    return kNone;
+}
@@ -0,0 +1,90 @@
+/**
+ * host/hal/sim.hh
+ *
+ * Modelo de custos e estado compartilhado pelos módulos simulados de
+ * `host/hal`. Todos os tempos estão em microsegundos do relógio simulado
+ * (`_simTime`, em `esp_timer.h`).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_timer.h"
+
+/// Duração de um comando SPI curto enviado ao radiotransmissor.
+#define SIM_SPI_COMMAND 20
+
+/// Duração da transferência de cada byte do buffer do radiotransmissor.
+#define SIM_SPI_BYTE 1
+
+/// Duração da calibração de imagem feita ao mudar a frequência.
+#define SIM_CALIBRATION 3500
+
+/// Atraso entre o interrupt do radiotransmissor e a task que o aguarda.
+#define SIM_IRQ_LATENCY 40
+
+/// Atraso entre o alarme do timer e a execução da função do usuário.
+#define SIM_TIMER_LATENCY 30
+
+/// Duração da saída do radiotransmissor do sleep, com a partida do TCXO.
+#define SIM_RADIO_WAKE 5400
+
+/// Atraso do ESP32 ao acordar do light sleep em relação ao instante pedido.
+#define SIM_CPU_WAKE 600
+
+/// Avança o relógio simulado em `micro` microsegundos.
+void simAdvance(int64_t micro) {
+    _simTime += micro;
+}
+
+/// Avança o relógio simulado até o instante dado, caso ainda não tenha
+/// passado.
+void simAdvanceTo(int64_t time) {
+    if (time > _simTime)
+        _simTime = time;
+}
+
+/// Um pacote entregue ao radiotransmissor simulado.
+struct sim_packet_t {
+    /// Tempo, a partir do início da recepção, até o início e o fim do
+    /// pacote. O timeout da recepção é interrompido caso o pacote comece
+    /// antes dele.
+    int64_t begin;
+    int64_t end;
+
+    int16_t rssi;
+    float snr;
+};
+
+// As funções abaixo são implementadas por `host/sim.cpp`, que conhece o
+// estado do experimento.
+
+/// Modela o outro aparelho: preenche `dest` e `*length` com o pacote que
+/// seria recebido por uma recepção iniciada agora. Retorna `false` caso
+/// nenhum pacote chegue.
+bool simReceive(uint8_t* dest, uint8_t* length, sim_packet_t* packet);
+
+/// Executado após cada execução da função do usuário do timer, com o
+/// instante do alarme e o período do slot.
+void simSlotFinished(void (*fn)(void), int64_t tick, uint64_t period);
+
+static struct {
+    /// Tempo no ar dos pacotes enviados e recebidos.
+    int64_t airtime;
+
+    /// Tempo gasto em comandos SPI e calibrações.
+    int64_t radioCommands;
+    uint32_t calibrations;
+
+    /// Tempo do radiotransmissor em sleep e do ESP32 em light sleep.
+    int64_t radioSleep;
+    int64_t cpuSleep;
+
+    /// Bytes e escritas feitas no datalogger.
+    uint64_t logBytes;
+    uint32_t logWrites;
+
+    /// Tempo real do computador gasto nas escritas, em nanosegundos.
+    uint64_t logHostNanos;
+} _simStats;
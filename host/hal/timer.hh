@@ -0,0 +1,122 @@
+/**
+ * host/hal/timer.hh
+ *
+ * Timer periódico simulado, com a mesma interface de `hal/timer.hh`. Os
+ * alarmes são executados por `simTimerStep`, que avança o relógio simulado
+ * até o próximo alarme, aplicando `timerResync` e `timerNudge` da mesma
+ * forma que `_timerCallback`.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "probe.hh"
+#include "sim.hh"
+
+using timer_handler_fn = void (*)(void);
+
+static struct {
+    bool running;
+    timer_handler_fn fn;
+
+    /// O período atual, sem os ajustes de `timerNudge`.
+    uint64_t period;
+
+    /// O período e a função aplicados no próximo alarme.
+    uint64_t nextPeriod;
+    timer_handler_fn nextFn;
+
+    int64_t nudge;
+
+    /// O instante do próximo alarme.
+    int64_t next;
+} _timerState;
+
+void timerInit() {}
+
+void timerStart(uint64_t micro, timer_handler_fn fn) {
+    _timerState = {};
+    _timerState.running = true;
+    _timerState.fn = fn;
+    _timerState.period = micro;
+    _timerState.next = _simTime + micro;
+}
+
+void timerResync(uint64_t micro, timer_handler_fn fn) {
+    _timerState.nextPeriod = micro;
+    _timerState.nextFn = fn;
+}
+
+void timerNudge(int64_t micro) {
+    _timerState.nudge = micro;
+}
+
+int64_t timerLatency() {
+    return SIM_TIMER_LATENCY;
+}
+
+int64_t timerTime() {
+    return _simTime;
+}
+
+uint64_t timerPeriod() {
+    return _timerState.period;
+}
+
+int64_t timerNextTick() {
+    return _timerState.next;
+}
+
+void timerStop() {
+    _timerState.running = false;
+}
+
+#define TIMER_SLEEP_MIN 2000
+
+bool timerLightSleep(int64_t early) {
+    const int64_t wake = _timerState.next - early;
+
+    if (wake - _simTime < TIMER_SLEEP_MIN)
+        return false;
+
+    _simStats.cpuSleep += wake - _simTime;
+    simAdvanceTo(wake + SIM_CPU_WAKE);
+    probeRecord(kProbeCpuWake, SIM_CPU_WAKE);
+    return true;
+}
+
+/// Executa o próximo alarme do timer. Caso a função do usuário anterior
+/// tenha passado do alarme, ele é executado imediatamente, como no
+/// `esp_timer`. Retorna `false` caso o timer tenha sido parado.
+bool simTimerStep() {
+    if (!_timerState.running)
+        return false;
+
+    const int64_t tick = _timerState.next;
+    simAdvanceTo(tick);
+
+    if (_timerState.nextPeriod > 0) {
+        _timerState.period = _timerState.nextPeriod;
+        _timerState.nextPeriod = 0;
+
+        if (_timerState.nextFn) {
+            _timerState.fn = _timerState.nextFn;
+            _timerState.nextFn = NULL;
+        }
+    }
+
+    // O ajuste é aplicado apenas ao período que começa neste alarme
+    const int64_t nudged = (int64_t)_timerState.period + _timerState.nudge;
+    _timerState.next = tick + (nudged > 0 ? nudged : _timerState.period);
+    _timerState.nudge = 0;
+
+    const timer_handler_fn fn = _timerState.fn;
+    const uint64_t period = _timerState.period;
+
+    simAdvance(SIM_TIMER_LATENCY);
+    fn();
+    simSlotFinished(fn, tick, period);
+
+    return true;
+}
@@ -0,0 +1,52 @@
+/**
+ * host/hal/ui.hh
+ *
+ * Interface simulada, com a mesma interface de `hal/ui.hh`. Nada é
+ * desenhado, e a task da interface nunca executa, já que ela executa no
+ * outro núcleo e não afeta o timing do experimento.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "buttons.hh"
+#include "lib.hh"
+
+enum alignment_t { kLeft, kCenter, kRight };
+enum color_t { kWhite, kBlack, kInvert };
+
+enum rect_type_t {
+    kFill,
+    kStroke,
+    kDither,
+};
+
+using ui_render_fn = void (*)(void);
+
+void uiSetColor(color_t color) {}
+void uiAlign(alignment_t align) {}
+
+bool uiSetup() {
+    return true;
+}
+
+void uiLoop() {
+    uiUpdateButton();
+}
+
+void uiClear() {}
+void uiText(int16_t x, int16_t y, const char* text, color_t color = kInvert) {}
+
+bool uiButton(int16_t x, int16_t y, const char* text,
+              color_t selectedColor = kInvert) {
+    return false;
+}
+
+void uiRect(int16_t x, int16_t y, uint16_t w, uint16_t h,
+            rect_type_t type = kFill, color_t color = kInvert) {}
+void uiCheckbox(int16_t x, int16_t y, bool filled, color_t color = kInvert) {}
+void uiFinish() {}
+
+void uiTaskStart(ui_render_fn fn, uint32_t fps) {}
+void uiTaskStop() {}
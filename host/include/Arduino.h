@@ -0,0 +1,87 @@
+/**
+ * host/include/Arduino.h
+ *
+ * O mínimo do core Arduino usado pelo experimento, para compilá-lo no
+ * computador. O tempo é o relógio simulado de `esp_timer.h`, e o Serial
+ * escreve no stderr apenas caso habilitado pelo simulador.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT_PULLUP 0x05
+#define GPIO_NUM_0 0
+
+#define constrain(amt, low, high) \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+int digitalRead(uint8_t pin) {
+    return HIGH;
+}
+
+uint32_t millis() {
+    return _simTime / 1000;
+}
+
+uint32_t micros() {
+    return _simTime;
+}
+
+/// Avança o relógio simulado, como se a task dormisse.
+void delay(uint32_t ms) {
+    _simTime += (int64_t)ms * 1000;
+}
+
+class HardwareSerial {
+   public:
+    /// Caso `false`, as mensagens são descartadas.
+    bool enabled = false;
+
+    void begin(unsigned long baud) {}
+
+    explicit operator bool() const {
+        return true;
+    }
+
+    int vprintf(const char* format, va_list list) {
+        return enabled ? vfprintf(stderr, format, list) : 0;
+    }
+
+    int printf(const char* format, ...) {
+        va_list list;
+        va_start(list, format);
+        int res = vprintf(format, list);
+        va_end(list);
+        return res;
+    }
+
+    size_t print(const char* text) {
+        return printf("%s", text);
+    }
+
+    size_t print(long value) {
+        return printf("%ld", value);
+    }
+
+    size_t println(const char* text = "") {
+        return printf("%s\n", text);
+    }
+
+    size_t println(long value) {
+        return printf("%ld\n", value);
+    }
+};
+
+HardwareSerial Serial;
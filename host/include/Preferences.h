@@ -0,0 +1,69 @@
+/**
+ * host/include/Preferences.h
+ *
+ * Memória não volátil do ESP32, mantida apenas durante a simulação.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+class Preferences {
+   public:
+    bool begin(const char* name, bool readOnly = false) {
+        return true;
+    }
+
+    void end() {}
+
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) {
+        auto it = _values.find(key);
+        return it == _values.end() ? defaultValue : it->second;
+    }
+
+    size_t putUChar(const char* key, uint8_t value) {
+        _values[key] = value;
+        return 1;
+    }
+
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+        auto it = _values.find(key);
+        return it == _values.end() ? defaultValue : it->second;
+    }
+
+    size_t putUInt(const char* key, uint32_t value) {
+        _values[key] = value;
+        return 4;
+    }
+
+    size_t getBytesLength(const char* key) {
+        auto it = _bytes.find(key);
+        return it == _bytes.end() ? 0 : it->second.size();
+    }
+
+    size_t getBytes(const char* key, void* buffer, size_t length) {
+        auto it = _bytes.find(key);
+        if (it == _bytes.end() || it->second.size() > length)
+            return 0;
+
+        memcpy(buffer, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        _bytes[key].assign((const char*)value, length);
+        return length;
+    }
+
+    bool remove(const char* key) {
+        return _values.erase(key) + _bytes.erase(key) > 0;
+    }
+
+   private:
+    std::map<std::string, uint32_t> _values;
+    std::map<std::string, std::string> _bytes;
+};
@@ -0,0 +1,17 @@
+/**
+ * host/include/esp_timer.h
+ *
+ * Substitui o `esp_timer` do ESP-IDF pelo relógio simulado do simulador.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/// O relógio simulado, em microsegundos. Avança apenas pelos custos modelados
+/// em `host/hal/sim.hh` e pelas esperas do experimento.
+int64_t _simTime = 0;
+
+int64_t esp_timer_get_time() {
+    return _simTime;
+}
@@ -0,0 +1,19 @@
+/**
+ * host/include/freertos/FreeRTOS.h
+ *
+ * Apenas as definições do FreeRTOS usadas fora dos módulos substituídos em
+ * `host/hal`. O simulador executa em uma única thread, logo as seções
+ * críticas não fazem nada.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+struct portMUX_TYPE {
+    int unused;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
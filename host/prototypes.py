@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""
+host/prototypes.py
+
+Converte o sketch em um arquivo C++ comum, da mesma forma que o Arduino:
+inclui `Arduino.h` e declara os protótipos de todas as funções antes da
+primeira definição de função, para que elas possam ser usadas antes de
+serem definidas.
+
+    python3 host/prototypes.py heltec-lora-test.ino > sketch.cpp
+"""
+
+import re
+import sys
+
+# Uma definição de função no início da linha: tipo, nome, argumentos e `{`
+DEFINITION = re.compile(
+    r"^(?P<type>[A-Za-z_][\w:<>\*& ]*?[\s\*&]+)(?P<name>[A-Za-z_]\w*)\s*"
+    r"\((?P<args>[^;{}]*)\)\s*\{\s*$"
+)
+
+# Linhas que parecem definições, mas não são funções
+IGNORED = ("if", "for", "while", "switch", "struct", "enum", "static struct",
+           "union", "class", "namespace", "return", "else")
+
+
+def definitions(lines):
+    """Retorna o índice da linha inicial e a assinatura de cada função,
+    juntando assinaturas quebradas em várias linhas."""
+    i = 0
+    while i < len(lines):
+        line = lines[i]
+        start = i
+
+        # Juntar as linhas seguintes até o `{` da definição
+        if re.match(r"^[A-Za-z_]", line) and "(" in line and ";" not in line:
+            while "{" not in line and ";" not in line and i + 1 < len(lines):
+                i += 1
+                line += " " + lines[i].strip()
+
+        match = DEFINITION.match(line)
+        if match and not line.startswith(IGNORED):
+            yield start, match
+
+        i += 1
+
+
+def main():
+    with open(sys.argv[1]) as file:
+        lines = file.read().split("\n")
+
+    found = list(definitions(lines))
+    first = found[0][0]
+
+    prototypes = []
+    for _, match in found:
+        # Valores padrão não podem ser repetidos na definição
+        args = re.sub(r"\s*=\s*[^,)]+", "", match.group("args"))
+        name = match.group("name")
+        prototypes.append(f"{match.group('type')}{name}({args});")
+
+    output = ["#include <Arduino.h>", f'#line 1 "{sys.argv[1]}"']
+    output += lines[:first]
+    output += prototypes
+    output += [f'#line {first + 1} "{sys.argv[1]}"']
+    output += lines[first:]
+
+    print("\n".join(output))
+
+
+if __name__ == "__main__":
+    main()
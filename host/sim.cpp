@@ -0,0 +1,319 @@
+/**
+ * host/sim.cpp
+ *
+ * Executa o experimento completo no computador, com o relógio, o
+ * radiotransmissor, o timer e o datalogger simulados por `host/hal`. O outro
+ * aparelho é modelado por `simReceive`: no cargo de receptor, o simulador
+ * entrega a sincronização, com o cronograma, e as mensagens do
+ * transmissor, com a taxa de perda dada; no cargo de transmissor, nenhum
+ * pacote é recebido.
+ *
+ * Permite medir, sem o hardware, a duração do cronograma, o uso de cada tipo
+ * de slot em relação ao período reservado e o custo do datalogger.
+ *
+ * Compilação e uso, a partir da raiz do repositório:
+ *
+ *     host/build.sh
+ *     _host_build/sweepsim -r rx -d sd -p 0.1 > report.txt
+ *     tools/log2csv sd/log.bin > log.csv
+ *
+ * Com o cargo fixo na compilação (ex. `CXXFLAGS=-DROLE_RX host/build.sh`), a
+ * opção `-r` é ignorada.
+ *
+ * O diretório `-d` é usado como o cartão SD: o cronograma é lido de
+ * `schedule.txt`, como no transmissor, e o log é gravado em `log.bin`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+
+#include "sketch.cpp"
+
+/// Os tipos de slot executados pela função do timer.
+enum sim_slot_t {
+    kSlotMessage,
+    kSlotFeedback,
+    kSlotUplink,
+    kSlotReconfig,
+    kSlotBeacon,
+    kSlotKinds,
+};
+
+const char* const _slotNames[kSlotKinds] = {
+    "message",
+    "feedback",
+    "uplink",
+    "reconfig",
+    "beacon",
+};
+
+/// O uso medido de cada tipo de slot.
+struct sim_slot_stats_t {
+    uint32_t count;
+
+    /// Soma dos tempos ocupados e dos períodos reservados.
+    int64_t busy;
+    int64_t reserved;
+
+    int64_t maxBusy;
+    uint32_t overruns;
+};
+
+sim_slot_stats_t _slotStats[kSlotKinds] = {};
+
+static struct {
+    std::mt19937 rng;
+
+    /// A probabilidade de perda de cada mensagem.
+    float per;
+
+    /// A variação máxima, em microsegundos, do início dos pacotes.
+    int64_t jitter;
+} _simPeer;
+
+// Retorna um valor uniforme entre 0 e 1.
+float _simUniform() {
+    return std::uniform_real_distribution<float>(0, 1)(_simPeer.rng);
+}
+
+// Retorna um valor normal com a média e o desvio padrão dados.
+float _simNormal(float mean, float stddev) {
+    return std::normal_distribution<float>(mean, stddev)(_simPeer.rng);
+}
+
+bool simReceive(uint8_t* dest, uint8_t* length, sim_packet_t* packet) {
+    if (_role != kRx)
+        return false;
+
+    const radio_parameters_t& param = _radioApplied.parameters;
+    packet->rssi = (int16_t)_simNormal(-100, 4);
+    packet->snr = _simNormal(5, 2);
+
+    // Cabeçalho da sincronização, enviado logo ao iniciar
+    if (*length == sizeof(sync_header_t)) {
+        const sync_header_t header = {
+            .hash = scheduleHash(_scheduleSpec),
+            .test = 0,
+            .timing = _slotTiming,
+        };
+
+        memcpy(dest, &header, sizeof(header));
+        packet->begin = 0;
+        packet->end = radioTransmitTime(param, sizeof(header));
+        return true;
+    }
+
+    // Descrição do cronograma, enviada `SYNC_GAP` após o cabeçalho
+    if (*length == sizeof(schedule_spec_t)) {
+        memcpy(dest, &_scheduleSpec, sizeof(_scheduleSpec));
+        packet->begin = SYNC_GAP * 1000;
+        packet->end =
+            packet->begin + radioTransmitTime(param, sizeof(_scheduleSpec));
+        return true;
+    }
+
+    // Pacote de sincronização, enviado `SYNC_GAP` após a descrição
+    if (*length == 1) {
+        dest[0] = 0;
+        packet->begin = SYNC_GAP * 1000;
+        packet->end = packet->begin + radioTransmitTime(param, 1);
+        return true;
+    }
+
+    // Confirmação do transmissor no slot de feedback
+    if (*length == sizeof(feedback_t)) {
+        const feedback_t feedback = {
+            .test = _currentTest,
+            .messages = (uint16_t)_messageIndex,
+            .stop = _feedbackStop,
+            .done = _feedbackDone,
+        };
+
+        memcpy(dest, &feedback, sizeof(feedback));
+        packet->begin = _slotTiming.txDelay;
+        packet->end = packet->begin + radioTransmitTime(param, *length);
+        return true;
+    }
+
+    // Mensagem do teste atual, com o atraso do início da transmissão
+    if (*length == sizeof(_packetRx)) {
+        if (_simUniform() < _simPeer.per)
+            return false;
+
+        const uint32_t txLatency = SIM_TIMER_LATENCY + 2 * SIM_SPI_COMMAND;
+        const int64_t jitter =
+            (int64_t)(_simUniform() * 2 * _simPeer.jitter) - _simPeer.jitter;
+
+        *length = packetLength();
+        memcpy(dest, packetFrame(_messageIndex), *length);
+        memcpy(dest + PACKET_LATENCY_OFFSET, &txLatency, sizeof(txLatency));
+
+        packet->begin = _slotTiming.txDelay + txLatency + jitter;
+        packet->end = packet->begin + radioTransmitTime(param, *length);
+        return true;
+    }
+
+    return false;
+}
+
+// Retorna o tipo do slot executado pela função dada.
+sim_slot_t _simSlotKind(void (*fn)(void)) {
+    if (fn == verdictLoop || fn == echoLoop)
+        return kSlotFeedback;
+
+    if (fn == uplinkLoop)
+        return kSlotUplink;
+
+    if (fn == nextTestLoop)
+        return kSlotReconfig;
+
+    if (fn == beaconLoop)
+        return kSlotBeacon;
+
+    return kSlotMessage;
+}
+
+void simSlotFinished(void (*fn)(void), int64_t tick, uint64_t period) {
+    sim_slot_stats_t& stats = _slotStats[_simSlotKind(fn)];
+    const int64_t busy = _simTime - tick;
+
+    stats.count++;
+    stats.busy += busy;
+    stats.reserved += period;
+
+    if (busy > stats.maxBusy)
+        stats.maxBusy = busy;
+
+    if (busy > (int64_t)period)
+        stats.overruns++;
+}
+
+// Imprime o relatório da simulação.
+void _simReport(int64_t begin) {
+    const double seconds = (_simTime - begin) / 1e6;
+
+    printf("sweep: %.3f s, tests: %u, messages: %u (ok %u, corrupt %u, "
+           "lost %u)\n",
+           seconds, _slotStats[kSlotReconfig].count,
+           _slotStats[kSlotMessage].count, _testsOk, _testsCorrupt,
+           _testsLost);
+
+    printf("\n%-10s %8s %12s %12s %8s %10s %9s\n", "slot", "count",
+           "busy (ms)", "period (ms)", "use (%)", "max (us)", "overruns");
+
+    for (int i = 0; i < kSlotKinds; i++) {
+        const sim_slot_stats_t& stats = _slotStats[i];
+        const double use =
+            stats.reserved > 0 ? 100.0 * stats.busy / stats.reserved : 0;
+
+        printf("%-10s %8u %12.1f %12.1f %8.1f %10lld %9u\n", _slotNames[i],
+               stats.count, stats.busy / 1e3, stats.reserved / 1e3, use,
+               (long long)stats.maxBusy, stats.overruns);
+    }
+
+    printf("\nairtime: %.3f s (%.1f%%)\n", _simStats.airtime / 1e6,
+           100.0 * _simStats.airtime / (_simTime - begin));
+    printf("radio commands: %.3f s, calibrations: %u\n",
+           _simStats.radioCommands / 1e6, _simStats.calibrations);
+    printf("sleep: radio %.3f s, cpu %.3f s\n", _simStats.radioSleep / 1e6,
+           _simStats.cpuSleep / 1e6);
+
+    const double perWrite =
+        _simStats.logWrites > 0
+            ? (double)_simStats.logHostNanos / _simStats.logWrites
+            : 0;
+
+    printf("log: %llu bytes in %u writes, %.1f bytes/s, %.0f ns/write "
+           "(host)\n",
+           (unsigned long long)_simStats.logBytes, _simStats.logWrites,
+           _simStats.logBytes / seconds, perWrite);
+}
+
+void _simUsage(const char* name) {
+    fprintf(stderr,
+            "uso: %s [-r tx|rx] [-d sd] [-p per] [-j jitter] [-s seed] "
+            "[-v]\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    role_t role = kRx;
+    std::string root = ".";
+    unsigned seed = 1;
+
+    _simPeer.per = 0;
+    _simPeer.jitter = 200;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:p:j:s:v")) != -1) {
+        switch (opt) {
+        case 'r':
+            if (strcmp(optarg, "tx") == 0)
+                role = kTx;
+            else if (strcmp(optarg, "rx") == 0)
+                role = kRx;
+            else
+                _simUsage(argv[0]);
+            break;
+        case 'd':
+            root = optarg;
+            break;
+        case 'p':
+            _simPeer.per = atof(optarg);
+            break;
+        case 'j':
+            _simPeer.jitter = atoll(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'v':
+            Serial.enabled = true;
+            break;
+        default:
+            _simUsage(argv[0]);
+        }
+    }
+
+    _simPeer.rng.seed(seed);
+
+    // Começar um log novo a cada execução
+    _logRoot = root;
+    remove((root + LOG_FILENAME).c_str());
+
+    setup();
+#ifdef FIXED_ROLE
+    role = _role;
+#else
+    _role = role;
+#endif
+
+    // No cargo de receptor, o cronograma é o enviado pelo transmissor
+    // simulado
+    static char scheduleText[1024];
+    if (role == kRx &&
+        logReadFile(SCHEDULE_FILENAME, scheduleText, sizeof(scheduleText)) &&
+        !scheduleParse(scheduleText, &_scheduleSpec)) {
+        fprintf(stderr, "Erro ao ler " SCHEDULE_FILENAME "\n");
+        return 1;
+    }
+
+    syncLoop();
+    if (_protoState != kRunning) {
+        fprintf(stderr, "Erro na sincronização\n");
+        return 1;
+    }
+
+    const int64_t begin = _begin;
+    while (simTimerStep()) {
+    }
+
+    _simReport(begin);
+    return 0;
+}
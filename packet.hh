@@ -0,0 +1,122 @@
+/**
+ * packet.hh
+ *
+ * Construção e validação das mensagens enviadas durante o experimento. O
+ * pacote de um teste é gerado antes do seu início, e cada mensagem apenas
+ * troca o byte do índice, de forma que o slot apenas copia o pacote pronto
+ * para o radiotransmissor, com qualquer quantidade de mensagens por teste. O
+ * receptor valida o conteúdo recebido diretamente no buffer de recepção, sem
+ * copiá-lo para o resultado.
+ *
+ * Formato de cada pacote:
+ *
+ *     [0]       índice da mensagem no teste (módulo 256)
+ *     [1..4]    atraso do início da transmissão (`uint32_t`, em
+ *               microsegundos), escrito no buffer do radio no início do slot
+ *     [5..]     `_packetPattern` repetido até o comprimento do payload
+ *
+ * Payloads menores que o cabeçalho contêm apenas os seus primeiros bytes.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/// O comprimento máximo de um pacote LoRa, em bytes.
+#define PACKET_MAX_LENGTH 255
+
+/// Posição, no pacote, do índice da mensagem.
+#define PACKET_INDEX_OFFSET 0
+
+/// Posição, no pacote, do atraso entre o início do slot do transmissor e o
+/// início da transmissão.
+#define PACKET_LATENCY_OFFSET 1
+
+/// Comprimento do cabeçalho, antes do padrão repetido.
+#define PACKET_HEADER_LENGTH (PACKET_LATENCY_OFFSET + sizeof(uint32_t))
+
+/// O padrão repetido no payload de cada mensagem.
+const char _packetPattern[] = "XMensagem";
+
+static struct {
+    /// O pacote do teste atual, com o índice da última mensagem pedida a
+    /// `packetFrame`.
+    uint8_t frame[PACKET_MAX_LENGTH];
+
+    /// O comprimento dos pacotes atuais.
+    uint8_t length;
+} _packetTemplate;
+
+/// Buffer de recepção, validado diretamente por `packetValidate`.
+uint8_t _packetRx[PACKET_MAX_LENGTH];
+
+/// Retorna o byte esperado na posição dada do pacote de índice `index`,
+/// exceto o atraso da transmissão, que não é conhecido pelo receptor.
+uint8_t _packetByte(uint16_t index, uint8_t position) {
+    if (position == PACKET_INDEX_OFFSET)
+        return index;
+
+    const uint8_t patternLength = sizeof(_packetPattern) - 1;
+    return _packetPattern[(position - PACKET_HEADER_LENGTH) % patternLength];
+}
+
+/// Gera o pacote das mensagens de um teste com o comprimento dado. O atraso
+/// da transmissão é deixado zerado.
+void packetBuildFrame(uint8_t length) {
+    _packetTemplate.length = length;
+
+    for (uint8_t p = 0; p < length; p++) {
+        const bool latency =
+            p >= PACKET_LATENCY_OFFSET && p < PACKET_HEADER_LENGTH;
+        _packetTemplate.frame[p] = latency ? 0 : _packetByte(0, p);
+    }
+}
+
+/// Retorna o pacote pronto da mensagem de índice dado, com o comprimento
+/// `packetLength()`. O buffer é compartilhado por todas as mensagens, logo o
+/// pacote deve ser usado antes da próxima chamada.
+const uint8_t* packetFrame(uint16_t index) {
+    _packetTemplate.frame[PACKET_INDEX_OFFSET] =
+        _packetByte(index, PACKET_INDEX_OFFSET);
+    return _packetTemplate.frame;
+}
+
+/// Retorna o comprimento dos pacotes do teste atual.
+uint8_t packetLength() {
+    return _packetTemplate.length;
+}
+
+/// Compara um pacote recebido com o pacote esperado para a mensagem de
+/// índice dado, sem copiá-lo. Retorna a quantidade de bytes diferentes,
+/// incluindo os bytes faltando ou excedentes em relação ao comprimento atual.
+/// Não modifica o pacote de `packetFrame`, podendo executar em paralelo com
+/// o transmissor no modo de loopback.
+uint8_t packetValidate(const uint8_t* data, uint8_t length, uint16_t index) {
+    const uint8_t expected = _packetTemplate.length;
+    const uint8_t common = length < expected ? length : expected;
+    const uint8_t* frame = _packetTemplate.frame;
+    uint8_t errors = length > expected ? length - expected : expected - length;
+
+    for (uint8_t p = 0; p < common; p++) {
+        if (p >= PACKET_LATENCY_OFFSET && p < PACKET_HEADER_LENGTH)
+            continue;
+
+        const uint8_t byte = p == PACKET_INDEX_OFFSET
+                                 ? _packetByte(index, p)
+                                 : frame[p];
+        errors += data[p] != byte;
+    }
+
+    return errors;
+}
+
+/// Lê o atraso da transmissão de um pacote recebido. Retorna `false` caso o
+/// pacote seja curto demais para contê-lo.
+bool packetTxLatency(const uint8_t* data, uint8_t length, uint32_t* latency) {
+    if (length < PACKET_HEADER_LENGTH)
+        return false;
+
+    memcpy(latency, data + PACKET_LATENCY_OFFSET, sizeof(*latency));
+    return true;
+}
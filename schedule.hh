@@ -0,0 +1,504 @@
+/**
+ * schedule.hh
+ *
+ * Cronograma de combinações de parâmetros testadas no experimento. O
+ * cronograma é descrito por um `schedule_spec_t`, contendo os valores de cada
+ * dimensão, que é expandido em uma tabela com todas as combinações antes do
+ * início do experimento.
+ *
+ * A descrição pode ser lida de um arquivo de texto no cartão SD, no formato:
+ *
+ *     # Comentário
+ *     power = 5, 10, 17, 22
+ *     sf = 7, 8, 9, 10, 11, 12
+ *     cr = 5, 8
+ *     bw = 62.5, 125, 250
+ *     frequency = 915
+ *     preamble = 8
+ *     payload = 10, 50, 255
+ *     implicit = 0, 1    # 1 para header implícito, com o comprimento fixo
+ *     order = index      # index, sf ou toa
+ *     skip = 3, 17       # índices das combinações puladas
+ *     nodes = 2          # receptores que enviam resumos de cada teste
+ *     adaptive = 10      # mensagens entre os slots de feedback, ou 0
+ *     hop = 902.3, 0.2, 64, 7   # início, espaçamento, canais e semente
+ *
+ * Dimensões ausentes no arquivo mantêm os valores padrão.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "hal/radio.hh"
+
+/// Quantidade máxima de valores em cada dimensão do cronograma.
+#define SCHEDULE_MAX_VALUES 8
+
+/// Quantidade máxima de combinações puladas.
+#define SCHEDULE_MAX_SKIPS 16
+
+/// Quantidade máxima de combinações no cronograma.
+#define SCHEDULE_MAX_TESTS 512
+
+/// Quantidade máxima de canais da sequência de saltos de frequência.
+#define SCHEDULE_MAX_HOPS 64
+
+/// Define a ordem em que as combinações são executadas.
+enum schedule_order_t : uint8_t {
+    /// A ordem original, variando a largura de banda mais rapidamente,
+    /// seguida do CR, SF, potência, preâmbulo, payload, header e frequência.
+    kOrderIndex,
+
+    /// Agrupa as combinações com a mesma frequência, SF, largura de banda e
+    /// CR, minimizando a reconfiguração do radio entre os testes.
+    kOrderSf,
+
+    /// Executa as combinações com menor ToA primeiro.
+    kOrderToa,
+};
+
+/// Descreve todas as dimensões de um cronograma. Enviado pelo transmissor na
+/// sincronização, para que o receptor gere a mesma tabela.
+///
+/// Os campos estão ordenados pelo alinhamento, evitando acessos desalinhados
+/// aos vetores sem precisar empacotar a estrutura.
+struct schedule_spec_t {
+    float bandwidth[SCHEDULE_MAX_VALUES];
+    float frequency[SCHEDULE_MAX_VALUES];
+
+    /// Canais, em MHz, da sequência de saltos de frequência: as mensagens de
+    /// todos os testes percorrem os canais `hopStart + i * hopStep`, para
+    /// `i < hopCount`, na ordem embaralhada por `hopSeed`. Os canais devem
+    /// estar na mesma banda de calibração das frequências dos testes, já que
+    /// `radioHop` não refaz a calibração (ver `radioCalibrationBand`).
+    float hopStart;
+    float hopStep;
+
+    uint16_t preamble[SCHEDULE_MAX_VALUES];
+
+    /// Índices, na ordem original, das combinações que não serão testadas.
+    uint16_t skip[SCHEDULE_MAX_SKIPS];
+    uint16_t hopSeed;
+
+    int8_t power[SCHEDULE_MAX_VALUES];
+    uint8_t sf[SCHEDULE_MAX_VALUES];
+    uint8_t cr[SCHEDULE_MAX_VALUES];
+    uint8_t payload[SCHEDULE_MAX_VALUES];
+
+    /// Caso diferente de 0, a combinação usa o header implícito, cujo
+    /// comprimento é o payload da combinação.
+    uint8_t implicit[SCHEDULE_MAX_VALUES];
+
+    /// A quantidade de valores em cada dimensão.
+    uint8_t bandwidthCount;
+    uint8_t frequencyCount;
+    uint8_t preambleCount;
+    uint8_t skipCount;
+    uint8_t powerCount;
+    uint8_t sfCount;
+    uint8_t crCount;
+    uint8_t payloadCount;
+    uint8_t implicitCount;
+
+    schedule_order_t order;
+
+    /// Quantidade de receptores que enviam um resumo ao transmissor ao fim
+    /// de cada teste, cada um em seu próprio slot. Caso 0, nenhum resumo é
+    /// enviado.
+    uint8_t nodes;
+
+    /// Intervalo, em mensagens, entre os slots de feedback em que o receptor
+    /// pode encerrar o teste antecipadamente, caso o PER já tenha convergido.
+    /// Caso 0, todos os testes enviam `MESSAGES_PER_TEST` mensagens.
+    uint8_t adaptive;
+
+    /// A quantidade de canais da sequência de saltos. Caso 0, todas as
+    /// mensagens usam a frequência do teste.
+    uint8_t hopCount;
+};
+
+/// Uma combinação de parâmetros do cronograma.
+struct schedule_entry_t {
+    radio_parameters_t parameters;
+
+    /// O comprimento da mensagem enviada, em bytes.
+    uint8_t payloadLength;
+
+    /// O índice da combinação na ordem original.
+    uint16_t index;
+
+    /// O ToA da mensagem nesta combinação, em microsegundos.
+    uint64_t toa;
+};
+
+/// Retorna a descrição do cronograma padrão do experimento.
+schedule_spec_t scheduleDefault(uint8_t payloadLength) {
+    return schedule_spec_t {
+        .bandwidth = { 62.5, 125.0, 250.0 },
+        .frequency = { 915.0 },
+        .hopStart = 0,
+        .hopStep = 0,
+        .preamble = { 8 },
+        .skip = {},
+        .hopSeed = 0,
+        .power = { 5, 10, 17, 22 },
+        .sf = { 7, 8, 9, 10, 11, 12 },
+        .cr = { 5, 8 },
+        .payload = { payloadLength },
+        .implicit = { 0 },
+        .bandwidthCount = 3,
+        .frequencyCount = 1,
+        .preambleCount = 1,
+        .skipCount = 0,
+        .powerCount = 4,
+        .sfCount = 6,
+        .crCount = 2,
+        .payloadCount = 1,
+        .implicitCount = 1,
+        .order = kOrderIndex,
+        .nodes = 0,
+        .adaptive = 0,
+        .hopCount = 0,
+    };
+}
+
+// Lê uma lista de números separados por vírgula em `dest`. Zera `*ok` caso
+// algum valor esteja fora do intervalo de `low` a `high`, ou caso a lista
+// tenha mais de `max` valores.
+template <typename T>
+uint8_t _scheduleParseList(const char* text, T* dest, uint8_t max, double low,
+                           double high, bool* ok) {
+    uint8_t count = 0;
+
+    while (*text) {
+        char* end;
+        double value = strtod(text, &end);
+
+        if (end == text)
+            break;
+
+        if (count == max || value < low || value > high) {
+            *ok = false;
+            break;
+        }
+
+        dest[count++] = (T)value;
+        text = end;
+
+        // Pular o separador
+        while (*text == ' ' || *text == '\t' || *text == ',')
+            text++;
+    }
+
+    *ok &= strspn(text, " \t\r") == strlen(text);
+    return count;
+}
+
+// Retorna `true` caso a largura de banda, em kHz, seja suportada pelo
+// SX1262.
+bool _scheduleValidBandwidth(float bandwidth) {
+    const float valid[] = { 7.8,  10.4, 15.6,  20.8,  31.25,
+                            41.7, 62.5, 125.0, 250.0, 500.0 };
+
+    for (float value : valid) {
+        if (bandwidth > value - 0.01f && bandwidth < value + 0.01f)
+            return true;
+    }
+
+    return false;
+}
+
+/// Retorna a quantidade de combinações geradas pela descrição dada, sem as
+/// combinações puladas.
+size_t scheduleCount(const schedule_spec_t& spec) {
+    const size_t total = (size_t)spec.bandwidthCount * spec.crCount *
+                         spec.sfCount * spec.powerCount * spec.preambleCount *
+                         spec.payloadCount * spec.implicitCount *
+                         spec.frequencyCount;
+    size_t skipped = 0;
+
+    // Contar cada índice pulado uma única vez
+    for (uint8_t s = 0; s < spec.skipCount; s++) {
+        bool repeated = false;
+        for (uint8_t r = 0; r < s; r++)
+            repeated |= spec.skip[r] == spec.skip[s];
+
+        skipped += !repeated && spec.skip[s] < total;
+    }
+
+    return total - skipped;
+}
+
+/// Lê a descrição de um cronograma no formato descrito no início deste
+/// arquivo, atualizando os campos presentes em `*spec`. Retorna `false` caso
+/// alguma linha seja inválida, algum valor esteja fora dos limites do
+/// SX1262, algum canal de salto esteja fora da banda de calibração das
+/// frequências dos testes, ou o cronograma tenha mais de `SCHEDULE_MAX_TESTS`
+/// combinações. Neste caso, `*spec` pode estar parcialmente atualizado.
+bool scheduleParse(const char* text, schedule_spec_t* spec) {
+    bool ok = true;
+    char line[128];
+
+    while (*text) {
+        // Copiar a próxima linha, sem o comentário
+        size_t length = strcspn(text, "\n");
+        size_t copied = length < sizeof(line) - 1 ? length : sizeof(line) - 1;
+        memcpy(line, text, copied);
+        line[copied] = '\0';
+        text += length + (text[length] == '\n');
+
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char* equals = strchr(line, '=');
+        if (equals == NULL) {
+            ok &= strspn(line, " \t\r") == strlen(line);
+            continue;
+        }
+
+        // Separar a chave dos valores
+        *equals = '\0';
+        char* key = line + strspn(line, " \t");
+        key[strcspn(key, " \t")] = '\0';
+
+        const char* values = equals + 1;
+        values += strspn(values, " \t");
+
+        if (strcmp(key, "power") == 0) {
+            spec->powerCount = _scheduleParseList(
+                values, spec->power, SCHEDULE_MAX_VALUES, -9, 22, &ok);
+        } else if (strcmp(key, "sf") == 0) {
+            spec->sfCount = _scheduleParseList(values, spec->sf,
+                                               SCHEDULE_MAX_VALUES, 5, 12, &ok);
+        } else if (strcmp(key, "cr") == 0) {
+            spec->crCount = _scheduleParseList(values, spec->cr,
+                                               SCHEDULE_MAX_VALUES, 5, 8, &ok);
+        } else if (strcmp(key, "bw") == 0) {
+            spec->bandwidthCount = _scheduleParseList(
+                values, spec->bandwidth, SCHEDULE_MAX_VALUES, 0, 500, &ok);
+
+            for (uint8_t i = 0; i < spec->bandwidthCount; i++)
+                ok &= _scheduleValidBandwidth(spec->bandwidth[i]);
+        } else if (strcmp(key, "frequency") == 0) {
+            spec->frequencyCount = _scheduleParseList(
+                values, spec->frequency, SCHEDULE_MAX_VALUES, 150, 960, &ok);
+        } else if (strcmp(key, "preamble") == 0) {
+            spec->preambleCount = _scheduleParseList(
+                values, spec->preamble, SCHEDULE_MAX_VALUES, 1, 65535, &ok);
+        } else if (strcmp(key, "payload") == 0) {
+            // Pacotes vazios não podem ser enviados
+            spec->payloadCount = _scheduleParseList(
+                values, spec->payload, SCHEDULE_MAX_VALUES, 1, 255, &ok);
+        } else if (strcmp(key, "implicit") == 0) {
+            spec->implicitCount = _scheduleParseList(
+                values, spec->implicit, SCHEDULE_MAX_VALUES, 0, 1, &ok);
+        } else if (strcmp(key, "skip") == 0) {
+            spec->skipCount = _scheduleParseList(
+                values, spec->skip, SCHEDULE_MAX_SKIPS, 0, 65535, &ok);
+        } else if (strcmp(key, "nodes") == 0) {
+            const uint8_t count =
+                _scheduleParseList(values, &spec->nodes, 1, 0, 255, &ok);
+            ok &= count == 1;
+        } else if (strcmp(key, "adaptive") == 0) {
+            const uint8_t count =
+                _scheduleParseList(values, &spec->adaptive, 1, 0, 255, &ok);
+            ok &= count == 1;
+        } else if (strcmp(key, "hop") == 0) {
+            // Os limites de cada valor são verificados abaixo
+            float hop[4] = { 0, 0, 0, 0 };
+            bool valid = true;
+            const uint8_t count =
+                _scheduleParseList(values, hop, 4, -1000, 65535, &valid);
+            const float last = hop[0] + hop[1] * (hop[2] - 1);
+            valid &= count >= 3 && hop[2] >= 0 && hop[2] <= SCHEDULE_MAX_HOPS &&
+                     hop[3] >= 0;
+
+            // Todos os canais devem estar na faixa do SX1262
+            valid &= hop[2] == 0 || (hop[0] >= 150 && hop[0] <= 960 &&
+                                     last >= 150 && last <= 960);
+
+            if (valid) {
+                spec->hopStart = hop[0];
+                spec->hopStep = hop[1];
+                spec->hopCount = hop[2];
+                spec->hopSeed = hop[3];
+            }
+
+            ok &= valid;
+        } else if (strcmp(key, "order") == 0) {
+            if (strncmp(values, "index", 5) == 0)
+                spec->order = kOrderIndex;
+            else if (strncmp(values, "sf", 2) == 0)
+                spec->order = kOrderSf;
+            else if (strncmp(values, "toa", 3) == 0)
+                spec->order = kOrderToa;
+            else
+                ok = false;
+        } else {
+            ok = false;
+        }
+    }
+
+    // Os saltos trocam a frequência sem recalibrar, logo todos os canais e
+    // todas as frequências dos testes devem estar em uma única banda. Como as
+    // bandas são contínuas, basta verificar o primeiro e o último canal
+    if (spec->hopCount > 0) {
+        const float last =
+            spec->hopStart + spec->hopStep * (spec->hopCount - 1);
+        const uint8_t band = radioCalibrationBand(spec->hopStart);
+
+        ok &= radioCalibrationBand(last) == band;
+        for (uint8_t i = 0; i < spec->frequencyCount; i++)
+            ok &= radioCalibrationBand(spec->frequency[i]) == band;
+    }
+
+    // Rejeitar cronogramas que seriam truncados por `scheduleBuild`
+    return ok && scheduleCount(*spec) <= SCHEDULE_MAX_TESTS;
+}
+
+/// A tabela de combinações gerada por `scheduleBuild`.
+schedule_entry_t _schedule[SCHEDULE_MAX_TESTS];
+size_t _scheduleLength = 0;
+
+/// A ordem dos canais da sequência de saltos, gerada por `scheduleBuild`.
+uint8_t _scheduleHops[SCHEDULE_MAX_HOPS];
+
+/// Embaralha a ordem dos canais com a semente da descrição. Usa um gerador
+/// próprio, para que todos os aparelhos gerem a mesma sequência.
+void _scheduleBuildHops(const schedule_spec_t& spec) {
+    uint32_t state = spec.hopSeed;
+
+    for (uint8_t i = 0; i < spec.hopCount; i++)
+        _scheduleHops[i] = i;
+
+    for (uint8_t i = spec.hopCount; i > 1; i--) {
+        state = state * 1664525 + 1013904223;
+        const uint8_t j = (state >> 16) % i;
+        std::swap(_scheduleHops[i - 1], _scheduleHops[j]);
+    }
+}
+
+/// Retorna a frequência, em MHz, da mensagem de posição `sequence` na
+/// sequência de saltos, contada desde o primeiro teste, em um teste com a
+/// frequência `frequency`.
+float scheduleHopFrequency(const schedule_spec_t& spec, float frequency,
+                           uint32_t sequence) {
+    if (spec.hopCount == 0)
+        return frequency;
+
+    const uint8_t channel = _scheduleHops[sequence % spec.hopCount];
+    return spec.hopStart + spec.hopStep * channel;
+}
+
+/// Gera a tabela de combinações a partir da descrição dada. Os parâmetros
+/// não descritos pelo cronograma são copiados de `base`. Retorna a quantidade
+/// de combinações geradas.
+size_t scheduleBuild(const schedule_spec_t& spec,
+                     const radio_parameters_t& base) {
+    const size_t total = (size_t)spec.bandwidthCount * spec.crCount *
+                         spec.sfCount * spec.powerCount * spec.preambleCount *
+                         spec.payloadCount * spec.implicitCount *
+                         spec.frequencyCount;
+
+    // Cronogramas maiores são rejeitados por `scheduleParse`
+
+    _scheduleLength = 0;
+    _scheduleBuildHops(spec);
+
+    for (size_t i = 0; i < total && _scheduleLength < SCHEDULE_MAX_TESTS;
+         i++) {
+        // Pular as combinações marcadas pelo usuário
+        bool skipped = false;
+        for (uint8_t s = 0; s < spec.skipCount; s++)
+            skipped |= spec.skip[s] == i;
+
+        if (skipped)
+            continue;
+
+        schedule_entry_t& entry = _schedule[_scheduleLength++];
+        entry.parameters = base;
+        entry.index = i;
+
+        // Decodificar o índice, variando a largura de banda mais rapidamente
+        size_t index = i;
+
+        entry.parameters.bandwidth =
+            spec.bandwidth[index % spec.bandwidthCount];
+        index /= spec.bandwidthCount;
+
+        entry.parameters.cr = spec.cr[index % spec.crCount];
+        index /= spec.crCount;
+
+        entry.parameters.sf = spec.sf[index % spec.sfCount];
+        index /= spec.sfCount;
+
+        entry.parameters.power = spec.power[index % spec.powerCount];
+        index /= spec.powerCount;
+
+        entry.parameters.preambleLength =
+            spec.preamble[index % spec.preambleCount];
+        index /= spec.preambleCount;
+
+        entry.payloadLength = spec.payload[index % spec.payloadCount];
+        index /= spec.payloadCount;
+
+        // O header implícito usa o comprimento fixo do payload
+        const bool implicit = spec.implicit[index % spec.implicitCount];
+        entry.parameters.packetLength = implicit ? entry.payloadLength : 0;
+        index /= spec.implicitCount;
+
+        entry.parameters.frequency =
+            spec.frequency[index % spec.frequencyCount];
+
+        entry.toa = radioTransmitTime(entry.parameters, entry.payloadLength);
+    }
+
+    schedule_entry_t* begin = _schedule;
+    schedule_entry_t* end = _schedule + _scheduleLength;
+
+    if (spec.order == kOrderSf) {
+        // Ordenar pelos parâmetros mais custosos de reconfigurar primeiro
+        std::stable_sort(begin, end, [](const schedule_entry_t& a,
+                                        const schedule_entry_t& b) {
+            const radio_parameters_t& pa = a.parameters;
+            const radio_parameters_t& pb = b.parameters;
+
+            if (pa.frequency != pb.frequency)
+                return pa.frequency < pb.frequency;
+            if (pa.sf != pb.sf)
+                return pa.sf < pb.sf;
+            if (pa.bandwidth != pb.bandwidth)
+                return pa.bandwidth < pb.bandwidth;
+            return pa.cr < pb.cr;
+        });
+    } else if (spec.order == kOrderToa) {
+        std::stable_sort(begin, end, [](const schedule_entry_t& a,
+                                        const schedule_entry_t& b) {
+            return a.toa < b.toa;
+        });
+    }
+
+    return _scheduleLength;
+}
+
+/// Retorna um identificador da descrição dada, usado para reconhecer o mesmo
+/// cronograma após uma reinicialização. Usa o hash FNV-1a dos campos, que
+/// não possuem preenchimento entre si, sem o preenchimento do fim da
+/// estrutura.
+uint32_t scheduleHash(const schedule_spec_t& spec) {
+    const uint8_t* data = (const uint8_t*)&spec;
+    const size_t size = offsetof(schedule_spec_t, hopCount) + 1;
+    uint32_t hash = 2166136261;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619;
+
+    return hash;
+}
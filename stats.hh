@@ -0,0 +1,75 @@
+/**
+ * stats.hh
+ *
+ * Estatísticas das medidas de cada teste, atualizadas a cada mensagem em
+ * tempo constante, para que o resumo do teste esteja pronto assim que a
+ * última mensagem for recebida, sem análise posterior do log.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+/// Quantidade de buckets dos histogramas de cada teste.
+#define STATS_BUCKETS 8
+
+/// Início e largura dos buckets do histograma de RSSI, em dBm. Medidas fora
+/// do intervalo são contadas no primeiro ou no último bucket.
+#define STATS_RSSI_START -130.0f
+#define STATS_RSSI_WIDTH 10.0f
+
+/// Início e largura dos buckets do histograma de SNR, em dB.
+#define STATS_SNR_START -20.0f
+#define STATS_SNR_WIDTH 4.0f
+
+/// Média e variância de uma série de medidas, calculadas pelo algoritmo de
+/// Welford, e seus extremos.
+struct running_stats_t {
+    uint32_t count;
+    float mean;
+
+    /// Soma dos quadrados das diferenças para a média.
+    float m2;
+
+    float min;
+    float max;
+};
+
+/// Adiciona uma medida às estatísticas.
+void statsAdd(running_stats_t* stats, float value) {
+    stats->count++;
+
+    const float delta = value - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (value - stats->mean);
+
+    if (stats->count == 1 || value < stats->min)
+        stats->min = value;
+
+    if (stats->count == 1 || value > stats->max)
+        stats->max = value;
+}
+
+/// Retorna a variância amostral das medidas, ou 0 caso haja menos de duas.
+float statsVariance(const running_stats_t& stats) {
+    return stats.count > 1 ? stats.m2 / (stats.count - 1) : 0;
+}
+
+/// Retorna o desvio padrão amostral das medidas.
+float statsStddev(const running_stats_t& stats) {
+    return sqrtf(statsVariance(stats));
+}
+
+/// Conta uma medida no histograma de buckets com o início e largura dados.
+void statsHistogramAdd(uint16_t* buckets, float value, float start,
+                       float width) {
+    const int32_t index = floorf((value - start) / width);
+
+    if (index < 0)
+        buckets[0]++;
+    else if (index >= STATS_BUCKETS)
+        buckets[STATS_BUCKETS - 1]++;
+    else
+        buckets[index]++;
+}
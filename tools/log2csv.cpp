@@ -0,0 +1,322 @@
+/**
+ * tools/log2csv.cpp
+ *
+ * Converte um log binário gravado pelo datalogger (ver `hal/log_format.hh`)
+ * para o mesmo CSV gravado pelo modo texto do experimento.
+ *
+ * Deve ser compilado e executado no computador:
+ *
+ *     g++ -O2 -o log2csv tools/log2csv.cpp
+ *     ./log2csv log.bin > log.csv
+ *
+ * Os resumos enviados pelos receptores ao transmissor são gravados em um
+ * segundo CSV, caso especificado:
+ *
+ *     ./log2csv log.bin log.csv resumos.csv
+ *
+ * A energia por bit de um teste sem nenhuma mensagem recebida é infinita, e
+ * aparece como `inf` no CSV de resumos.
+ *
+ * Sem o cartão SD, o mesmo log é enviado pelo Serial em quadros COBS. Com a
+ * opção `-s`, a entrada é lida como este fluxo, e cada linha é escrita assim
+ * que o seu quadro chega:
+ *
+ *     stty -F /dev/ttyUSB0 921600 raw
+ *     ./log2csv -s /dev/ttyUSB0 log.csv resumos.csv
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../hal/log_format.hh"
+
+/// Cargos gravados em `log_test_record_t::role`.
+#define ROLE_TX 1
+#define ROLE_RX 2
+
+/// Imprime o rótulo das colunas do CSV, dependendo do cargo do aparelho.
+void printHeader(FILE* out, uint8_t role) {
+    if (role == ROLE_RX) {
+        fprintf(out,
+                "Start Time,Rx End Time,End Time,Period,Alarm,Timer "
+                "Latency,IRQ Latency,Parameter Index,Message Index,Tx Power "
+                "(dBm),Spreading Factor,Coding Rate,Bandwidth (kHz),Frequency "
+                "(MHz),RSSI (dBm),SNR (dB),Status,Node,Length,Payload "
+                "Errors,Energy (J)\n");
+    } else {
+        fprintf(out,
+                "Start Time,Tx End Time,End Time,Period,Alarm,Timer "
+                "Latency,IRQ Latency,Parameter Index,Message Index,Tx Power "
+                "(dBm),Spreading Factor,Coding Rate,Bandwidth (kHz),Frequency "
+                "(MHz),Status,Energy (J)\n");
+    }
+}
+
+/// Imprime uma linha do CSV para o resultado de uma mensagem.
+void printMessage(FILE* out, const log_test_record_t& test,
+                  const log_message_record_t& result) {
+    // O transmissor imprime a potência sem sinal
+    const char* format =
+        test.role == ROLE_RX
+            ? "%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%hhd,%hhu,%hhu,%f,%f,"
+            : "%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%hhu,%hhu,%hhu,%f,%f,";
+
+    fprintf(out, format, (unsigned long long)result.startTime,
+            (unsigned long long)result.loraEndTime,
+            (unsigned long long)result.endTime,
+            (unsigned long long)result.period,
+            (unsigned long long)result.nextAlarm,
+            (unsigned)result.timerLatency, (unsigned)result.irqLatency,
+            (unsigned)test.test,
+            (unsigned)result.index, test.power, test.sf, test.cr,
+            (double)test.bandwidth, (double)result.frequency);
+
+    if (test.role == ROLE_RX) {
+        fprintf(out, "%hi,%f,%u,%u,%u,%u,%g\n", result.rssi,
+                (double)result.snr, result.error, test.node, result.length,
+                result.payloadErrors, (double)result.energy);
+    } else {
+        fprintf(out, "%u,%g\n", result.error, (double)result.energy);
+    }
+}
+
+/// Imprime uma linha do CSV de resumos.
+void printSummary(FILE* out, const log_summary_record_t& summary) {
+    fprintf(out, "%u,%u,%u,%u,%u,%f,%f,%f,%g,%g,%f,%f,%f,%f,%f,%f,",
+            summary.node, (unsigned)summary.test, summary.ok, summary.corrupt,
+            summary.lost, (double)summary.rssi, (double)summary.snr,
+            (double)summary.goodput, (double)summary.energy,
+            (double)summary.energyPerBit, (double)summary.rssiStddev,
+            (double)summary.snrStddev, (double)summary.rssiMin,
+            (double)summary.rssiMax, (double)summary.snrMin,
+            (double)summary.snrMax);
+
+    // Os buckets de cada histograma são separados por espaços, em uma única
+    // coluna
+    for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++) {
+        fprintf(out, i == 0 ? "%u" : " %u",
+                (unsigned)summary.rssiHistogram[i]);
+    }
+
+    fprintf(out, ",");
+
+    for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+        fprintf(out, i == 0 ? "%u" : " %u", (unsigned)summary.snrHistogram[i]);
+
+    fprintf(out, "\n");
+}
+
+/// Estado da conversão, compartilhado pelos registros do log.
+struct convert_state_t {
+    FILE* out;
+    FILE* summaries;
+
+    log_test_record_t test;
+    bool hasTest;
+    bool printedHeader;
+};
+
+/// Retorna o comprimento do registro do tipo dado, ou zero caso o tipo seja
+/// inválido.
+size_t recordSize(int type) {
+    switch (type) {
+    case kLogRecordTest:
+        return sizeof(log_test_record_t);
+    case kLogRecordMessage:
+        return sizeof(log_message_record_t);
+    case kLogRecordSummary:
+        return sizeof(log_summary_record_t);
+    default:
+        return 0;
+    }
+}
+
+/// Converte um registro completo, identificado pelo seu primeiro byte.
+void convertRecord(convert_state_t& state, const uint8_t* record) {
+    if (record[0] == kLogRecordTest) {
+        memcpy(&state.test, record, sizeof(state.test));
+
+        if (!state.printedHeader) {
+            printHeader(state.out, state.test.role);
+            state.printedHeader = true;
+        }
+
+        state.hasTest = true;
+    } else if (record[0] == kLogRecordMessage && state.hasTest) {
+        log_message_record_t result;
+        memcpy(&result, record, sizeof(result));
+        printMessage(state.out, state.test, result);
+    } else if (record[0] == kLogRecordSummary && state.summaries) {
+        log_summary_record_t summary;
+        memcpy(&summary, record, sizeof(summary));
+        printSummary(state.summaries, summary);
+    }
+}
+
+/// Verifica o cabeçalho do log. Retorna `false` caso o log não seja
+/// suportado.
+bool checkHeader(const log_file_header_t& header) {
+    if (header.magic != LOG_FORMAT_MAGIC)
+        return false;
+
+    if (header.version != LOG_FORMAT_VERSION) {
+        fprintf(stderr, "Versão do log não suportada (%u, esperado %u).\n",
+                header.version, LOG_FORMAT_VERSION);
+        return false;
+    }
+
+    return true;
+}
+
+/// Converte um log binário gravado no cartão SD.
+int convertFile(convert_state_t& state, FILE* in, const char* name) {
+    log_file_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        header.magic != LOG_FORMAT_MAGIC) {
+        fprintf(stderr, "'%s' não é um log binário.\n", name);
+        return 1;
+    }
+
+    if (!checkHeader(header))
+        return 1;
+
+    uint8_t record[LOG_FRAME_MAX_PAYLOAD];
+    int type;
+
+    // Cada registro é identificado pelo seu primeiro byte
+    while ((type = fgetc(in)) != EOF) {
+        const size_t size = recordSize(type);
+        if (size == 0) {
+            fprintf(stderr, "Registro inválido (%d) na posição %ld.\n", type,
+                    ftell(in) - 1);
+            return 1;
+        }
+
+        record[0] = type;
+        if (fread(record + 1, size - 1, 1, in) != 1)
+            break;
+
+        convertRecord(state, record);
+    }
+
+    return 0;
+}
+
+/// Converte o fluxo de quadros enviado pelo Serial. Quadros inválidos, como
+/// os textos impressos no mesmo Serial, são descartados. Como o receptor
+/// pode ser conectado no meio do experimento, o cabeçalho é opcional.
+int convertStream(convert_state_t& state, FILE* in) {
+    uint8_t frame[LOG_FRAME_MAX_SIZE];
+    uint8_t record[LOG_FRAME_MAX_SIZE];
+    size_t length = 0;
+    bool overflow = false;
+    uint32_t dropped = 0;
+    int byte;
+
+    while ((byte = fgetc(in)) != EOF) {
+        if (byte != LOG_FRAME_DELIMITER) {
+            // Quadros longos demais nunca são válidos
+            if (length < sizeof(frame))
+                frame[length++] = byte;
+            else
+                overflow = true;
+
+            continue;
+        }
+
+        const size_t size =
+            length > 0 && !overflow ? logFrameDecode(frame, length, record)
+                                    : 0;
+        const bool delimited = length > 0;
+        length = 0;
+        overflow = false;
+
+        if (size == 0) {
+            dropped += delimited;
+            continue;
+        }
+
+        if (size == sizeof(log_file_header_t)) {
+            log_file_header_t header;
+            memcpy(&header, record, sizeof(header));
+
+            if (header.magic == LOG_FORMAT_MAGIC && !checkHeader(header))
+                return 1;
+
+            continue;
+        }
+
+        if (size != recordSize(record[0])) {
+            dropped++;
+            continue;
+        }
+
+        convertRecord(state, record);
+        fflush(state.out);
+
+        if (state.summaries)
+            fflush(state.summaries);
+    }
+
+    if (dropped > 0)
+        fprintf(stderr, "%u quadros inválidos descartados.\n", dropped);
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const bool stream = argc > 1 && strcmp(argv[1], "-s") == 0;
+    if (stream) {
+        argc--;
+        argv++;
+    }
+
+    if (argc < 2) {
+        fprintf(stderr,
+                "Uso: %s [-s] <log.bin> [saida.csv] [resumos.csv]\n",
+                argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "Não foi possível abrir '%s'.\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Não foi possível criar '%s'.\n", argv[2]);
+        return 1;
+    }
+
+    FILE* summaries = argc > 3 ? fopen(argv[3], "w") : NULL;
+    if (argc > 3 && !summaries) {
+        fprintf(stderr, "Não foi possível criar '%s'.\n", argv[3]);
+        return 1;
+    }
+
+    if (summaries) {
+        fprintf(summaries,
+                "Node,Parameter Index,Ok,Corrupt,Lost,Mean RSSI (dBm),Mean "
+                "SNR (dB),Goodput (bit/s),Energy (J),Energy per Bit (J/bit),"
+                "RSSI Stddev,SNR Stddev,Min RSSI,Max RSSI,Min SNR,Max SNR,"
+                "RSSI Histogram,SNR Histogram\n");
+    }
+
+    convert_state_t state = {};
+    state.out = out;
+    state.summaries = summaries;
+
+    const int res =
+        stream ? convertStream(state, in) : convertFile(state, in, argv[1]);
+
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+
+    if (summaries)
+        fclose(summaries);
+
+    return res;
+}